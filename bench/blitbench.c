@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Micro-benchmark for the glyph blit kernels in src/blit.c. Each kernel
+ * is first checked against the scalar one, then timed drawing screens of
+ * cells from a set of fake glyph masks, and the cells per second are
+ * printed.
+ *
+ * Usage: blitbench [cell_width cell_height [seconds]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "SDL.h"
+#include "blit.h"
+
+#define COLS 80
+#define ROWS 40
+#define NUM_GLYPHS 96
+
+static double now(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Roughly what text looks like: mostly empty, some solid stems, and
+ * anti-aliased edges. Glyph 0 is a blank cell. */
+static void make_glyphs(Uint8* masks, int cell_w, int cell_h){
+  int g, i;
+  int size = cell_w * cell_h;
+  memset(masks, 0, (size_t)NUM_GLYPHS * size);
+  for(g = 1; g < NUM_GLYPHS; ++g){
+    Uint8* m = masks + g * size;
+    for(i = 0; i < size; ++i){
+      int r = rand() % 100;
+      if(r < 25){
+        m[i] = 255;
+      } else if(r < 40){
+        m[i] = 1 + rand() % 254;
+      }
+    }
+  }
+}
+
+static int check_kernel(const struct blit_kernel* k){
+  int t;
+  Uint8 mask[37 * 19];
+  Uint32 want[37 * 19];
+  Uint32 got[37 * 19];
+  for(t = 0; t < 1000; ++t){
+    int i;
+    int w = 1 + rand() % 37;
+    int h = 1 + rand() % 19;
+    Uint32 fg = (Uint32)rand() << 16 ^ (Uint32)rand();
+    Uint32 bg = (Uint32)rand() << 16 ^ (Uint32)rand();
+    for(i = 0; i < 37 * 19; ++i){
+      int r = rand() % 3;
+      mask[i] = r == 0 ? 0 : r == 1 ? 255 : rand() % 256;
+    }
+    blit_mask_32_scalar(want, 37, mask, 37, w, h, fg, bg);
+    k->blit(got, 37, mask, 37, w, h, fg, bg);
+    for(i = 0; i < h; ++i){
+      if(memcmp(want + i * 37, got + i * 37, w * sizeof(Uint32)) != 0){
+        fprintf(stderr, "%s: doesn't match scalar kernel for %dx%d\n", k->name, w, h);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+static double bench_kernel(const struct blit_kernel* k, Uint32* screen, const Uint8* masks,
+                           int cell_w, int cell_h, double seconds){
+  long cells = 0;
+  int size = cell_w * cell_h;
+  int pitch = COLS * cell_w;
+  double start = now();
+  double elapsed;
+  do {
+    int row, col;
+    for(row = 0; row < ROWS; ++row){
+      for(col = 0; col < COLS; ++col){
+        int g = (row * COLS + col + (int)cells) % NUM_GLYPHS;
+        k->blit(screen + row * cell_h * pitch + col * cell_w, pitch,
+                masks + g * size, cell_w, cell_w, cell_h,
+                0xffd0d0d0, 0xff101010 + (Uint32)(col & 7));
+      }
+    }
+    cells += COLS * ROWS;
+    elapsed = now() - start;
+  } while(elapsed < seconds);
+  return cells / elapsed;
+}
+
+int main(int argc, char** argv){
+  int cell_w = 12;
+  int cell_h = 24;
+  double seconds = 1.0;
+  const struct blit_kernel* k;
+  Uint8* masks;
+  Uint32* screen;
+  int rc = EXIT_SUCCESS;
+
+  if(argc >= 3){
+    cell_w = atoi(argv[1]);
+    cell_h = atoi(argv[2]);
+  }
+  if(argc >= 4){
+    seconds = atof(argv[3]);
+  }
+  if(cell_w <= 0 || cell_h <= 0 || seconds <= 0){
+    fprintf(stderr, "Usage: %s [cell_width cell_height [seconds]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  masks = (Uint8*)malloc((size_t)NUM_GLYPHS * cell_w * cell_h);
+  screen = (Uint32*)malloc((size_t)COLS * cell_w * ROWS * cell_h * sizeof(Uint32));
+  if(masks == NULL || screen == NULL){
+    fprintf(stderr, "Couldn't allocate buffers\n");
+    return EXIT_FAILURE;
+  }
+  srand(48);
+  make_glyphs(masks, cell_w, cell_h);
+
+  printf("%dx%d cells, %dx%d screen\n", cell_w, cell_h, COLS, ROWS);
+  for(k = blit_kernels; k->name != NULL; ++k){
+    if(!check_kernel(k)){
+      rc = EXIT_FAILURE;
+      continue;
+    }
+    double rate = bench_kernel(k, screen, masks, cell_w, cell_h, seconds);
+    printf("%-8s %12.0f cells/s %8.1f ns/cell\n", k->name, rate, 1e9 / rate);
+  }
+
+  free(masks);
+  free(screen);
+  return rc;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SYS_KEYCODES_H_INCLUDED
+#define _SYS_KEYCODES_H_INCLUDED
+
+/* The key codes and modifiers Term48 uses, with their values from the
+ * BlackBerry 10 NDK's <sys/keycodes.h>, so the parser and renderer build
+ * for the renderer benchmark on a host without the NDK. */
+
+#define KEYMOD_SHIFT      0x00000001
+#define KEYMOD_CTRL       0x00000002
+#define KEYMOD_ALT        0x00000004
+#define KEYMOD_SHIFT_LOCK 0x00000100
+#define KEYMOD_CAPS_LOCK  0x00010000
+
+#define KEYCODE_PC_KEYS 0xF000
+#define KEYCODE_ESCAPE        (KEYCODE_PC_KEYS + 0x1b)
+#define KEYCODE_BACKSPACE     (KEYCODE_PC_KEYS + 0x08)
+#define KEYCODE_TAB           (KEYCODE_PC_KEYS + 0x09)
+#define KEYCODE_BACK_TAB      (KEYCODE_PC_KEYS + 0x89)
+#define KEYCODE_RETURN        (KEYCODE_PC_KEYS + 0x0d)
+#define KEYCODE_RIGHT_SHIFT   (KEYCODE_PC_KEYS + 0xe2)
+#define KEYCODE_INSERT        (KEYCODE_PC_KEYS + 0x63)
+#define KEYCODE_HOME          (KEYCODE_PC_KEYS + 0x50)
+#define KEYCODE_PG_UP         (KEYCODE_PC_KEYS + 0x55)
+#define KEYCODE_DELETE        (KEYCODE_PC_KEYS + 0xff)
+#define KEYCODE_END           (KEYCODE_PC_KEYS + 0x57)
+#define KEYCODE_PG_DOWN       (KEYCODE_PC_KEYS + 0x56)
+#define KEYCODE_LEFT          (KEYCODE_PC_KEYS + 0x51)
+#define KEYCODE_RIGHT         (KEYCODE_PC_KEYS + 0x53)
+#define KEYCODE_UP            (KEYCODE_PC_KEYS + 0x52)
+#define KEYCODE_DOWN          (KEYCODE_PC_KEYS + 0x54)
+#define KEYCODE_KP_PLUS       (KEYCODE_PC_KEYS + 0xab)
+#define KEYCODE_KP_MINUS      (KEYCODE_PC_KEYS + 0xad)
+#define KEYCODE_KP_MULTIPLY   (KEYCODE_PC_KEYS + 0xaa)
+#define KEYCODE_KP_DIVIDE     (KEYCODE_PC_KEYS + 0xaf)
+#define KEYCODE_KP_ENTER      (KEYCODE_PC_KEYS + 0x8d)
+#define KEYCODE_KP_HOME       (KEYCODE_PC_KEYS + 0xb7)
+#define KEYCODE_KP_UP         (KEYCODE_PC_KEYS + 0xb8)
+#define KEYCODE_KP_PG_UP      (KEYCODE_PC_KEYS + 0xb9)
+#define KEYCODE_KP_LEFT       (KEYCODE_PC_KEYS + 0xb4)
+#define KEYCODE_KP_FIVE       (KEYCODE_PC_KEYS + 0xb5)
+#define KEYCODE_KP_RIGHT      (KEYCODE_PC_KEYS + 0xb6)
+#define KEYCODE_KP_END        (KEYCODE_PC_KEYS + 0xb1)
+#define KEYCODE_KP_DOWN       (KEYCODE_PC_KEYS + 0xb2)
+#define KEYCODE_KP_PG_DOWN    (KEYCODE_PC_KEYS + 0xb3)
+#define KEYCODE_KP_INSERT     (KEYCODE_PC_KEYS + 0xb0)
+#define KEYCODE_KP_DELETE     (KEYCODE_PC_KEYS + 0xae)
+#define KEYCODE_F1            (KEYCODE_PC_KEYS + 0xbe)
+#define KEYCODE_F2            (KEYCODE_PC_KEYS + 0xbf)
+#define KEYCODE_F3            (KEYCODE_PC_KEYS + 0xc0)
+#define KEYCODE_F4            (KEYCODE_PC_KEYS + 0xc1)
+#define KEYCODE_F5            (KEYCODE_PC_KEYS + 0xc2)
+#define KEYCODE_F6            (KEYCODE_PC_KEYS + 0xc3)
+#define KEYCODE_F7            (KEYCODE_PC_KEYS + 0xc4)
+#define KEYCODE_F8            (KEYCODE_PC_KEYS + 0xc5)
+#define KEYCODE_F9            (KEYCODE_PC_KEYS + 0xc6)
+#define KEYCODE_F10           (KEYCODE_PC_KEYS + 0xc7)
+#define KEYCODE_F11           (KEYCODE_PC_KEYS + 0xc8)
+#define KEYCODE_F12           (KEYCODE_PC_KEYS + 0xc9)
+
+#define KEYCODE_SPACE         0x0020
+#define KEYCODE_SLASH         0x002f
+#define KEYCODE_LEFT_BRACKET  0x005b
+#define KEYCODE_BACK_SLASH    0x005c
+#define KEYCODE_RIGHT_BRACKET 0x005d
+#define KEYCODE_GRAVE         0x0060
+#define KEYCODE_A             0x0061
+#define KEYCODE_B             0x0062
+#define KEYCODE_C             0x0063
+#define KEYCODE_D             0x0064
+#define KEYCODE_E             0x0065
+#define KEYCODE_F             0x0066
+#define KEYCODE_G             0x0067
+#define KEYCODE_H             0x0068
+#define KEYCODE_I             0x0069
+#define KEYCODE_J             0x006a
+#define KEYCODE_K             0x006b
+#define KEYCODE_L             0x006c
+#define KEYCODE_M             0x006d
+#define KEYCODE_N             0x006e
+#define KEYCODE_O             0x006f
+#define KEYCODE_P             0x0070
+#define KEYCODE_Q             0x0071
+#define KEYCODE_R             0x0072
+#define KEYCODE_S             0x0073
+#define KEYCODE_T             0x0074
+#define KEYCODE_U             0x0075
+#define KEYCODE_V             0x0076
+#define KEYCODE_W             0x0077
+#define KEYCODE_X             0x0078
+#define KEYCODE_Y             0x0079
+#define KEYCODE_Z             0x007a
+
+#endif /* _SYS_KEYCODES_H_INCLUDED */
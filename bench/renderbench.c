@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Renderer benchmark. The parser and renderer run on their own, drawing
+ * into a surface in memory instead of a window, so they can be timed on
+ * the host without a display, a shell or the device. A few fixed
+ * workloads are played back through the parser, and the frames per
+ * second and nanoseconds per cell of each are printed.
+ *
+ * Usage: renderbench [-s WIDTHxHEIGHT] [-n FRAMES] [-o PNG_DIR] [-f FONT] [WORKLOAD...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include <unicode/utf.h>
+
+#include "SDL.h"
+#include "SDL_ttf.h"
+#include "types.h"
+#include "terminal.h"
+#include "preferences.h"
+#include "buffer.h"
+#include "ecma48.h"
+#include "io.h"
+#include "render.h"
+
+#define BENCH_WIDTH 720
+#define BENCH_HEIGHT 1280
+#define BENCH_FRAMES 200
+#define BENCH_WARMUP 10
+#define BENCH_GLYPH_ROUNDS 200
+
+/* from buffer.c */
+extern int rows;
+extern int cols;
+extern int MAX_COLS;
+extern int MAX_ROWS;
+extern int TEXT_BUFFER_SIZE;
+extern struct scroll_region sr;
+
+/* from render.c */
+extern SDL_Surface* screen;
+extern char headless;
+extern int text_width;
+extern int text_height;
+
+/* Stand-ins for what the parser and renderer use from main.c, io.c and
+ * preferences.c. The preferences are the defaults, without the glyph
+ * cache file, so a run neither reads nor writes ~/.term48glyphs and
+ * always starts from an empty atlas. */
+static int bench_text_color[] = {255, 255, 255};
+static int bench_background_color[] = {0, 0, 0};
+static char* bench_fallback_fonts[] = {NULL};
+static pref_t bench_prefs = {
+	.font_path = DEFAULT_FONT_PATH,
+	.font_bold_path = DEFAULT_FONT_BOLD_PATH,
+	.font_italic_path = DEFAULT_FONT_ITALIC_PATH,
+	.font_bold_italic_path = DEFAULT_FONT_BOLD_ITALIC_PATH,
+	.font_size = DEFAULT_FONT_SIZE,
+	.text_color = bench_text_color,
+	.background_color = bench_background_color,
+	.cursor_shape = DEFAULT_CURSOR_SHAPE,
+	.row_cache_size = DEFAULT_ROW_CACHE_SIZE,
+	.color_cache_size = DEFAULT_COLOR_CACHE_SIZE,
+	.render_threads = DEFAULT_RENDER_THREADS,
+	.glyph_cache = 0,
+	.fallback_fonts = bench_fallback_fonts,
+};
+pref_t* prefs = &bench_prefs;
+symmenu_t* current_symmenu = NULL;
+char altsym_lock = 0;
+char metamode = 0;
+int vmodifiers = 0;
+
+int preferences_guess_best_font_size(pref_t* p, int target_cols){
+	return p->font_size;
+}
+
+/* no shell: anything the terminal answers goes nowhere */
+ssize_t io_write_master_char(const char *buf, size_t n){
+	return n;
+}
+
+/* DECCOLM leaves the screen the size it is */
+void set_screen_cols(int ncols){
+}
+
+/* Set up the buffer and renderer to draw into a w x h surface in memory.
+ * Returns the surface. */
+static SDL_Surface* bench_init(int w, int h){
+	headless = 1;
+	if ( TTF_Init() < 0 ) {
+		fprintf(stderr, "Couldn't initialize TTF: %s\n",SDL_GetError());
+		return NULL;
+	}
+	/* the same layout as the device's screen */
+	screen = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, PB_D_PIXELS, 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
+	if ( screen == NULL ) {
+		fprintf(stderr, "Couldn't create %d x %d surface: %s\n", w, h, SDL_GetError());
+		return NULL;
+	}
+	if(font_init(prefs->font_size) == TERM_FAILURE){
+		return NULL;
+	}
+
+	/* as much buffer as the app allocates for this screen */
+	int largest_dimension = w > h ? w : h;
+	MAX_ROWS = largest_dimension / MIN_FONT_SIZE;
+	MAX_COLS = largest_dimension / MIN_FONT_SIZE;
+	TEXT_BUFFER_SIZE = MAX_ROWS * 2;
+	rows = h / text_height;
+	cols = w / text_width;
+	rows = rows < MAX_ROWS ? rows : MAX_ROWS;
+	cols = cols < MAX_COLS ? cols : MAX_COLS;
+	if(buf_init() == TERM_FAILURE || render_init() == TERM_FAILURE){
+		return NULL;
+	}
+	sr.top = 1;
+	sr.bottom = rows;
+	ecma48_init();
+	return screen;
+}
+
+struct workload {
+	const char* name;
+	void (*setup)();
+	void (*frame)(int n);
+};
+
+static UChar* text = NULL;
+static size_t text_len = 0;
+static size_t text_size = 0;
+
+static void put_str(const char* s){
+	while(*s != '\0' && text_len < text_size){
+		text[text_len++] = (UChar)*s++;
+	}
+}
+
+static void put_char(UChar c){
+	if(text_len < text_size){
+		text[text_len++] = c;
+	}
+}
+
+static void put_csi(const char* fmt, int a, int b){
+	char seq[32];
+	snprintf(seq, sizeof(seq), fmt, a, b);
+	put_str(seq);
+}
+
+static void flush_text(){
+	if(text_len > 0){
+		ecma48_filter_text(text, (ssize_t)text_len);
+	}
+	text_len = 0;
+}
+
+/* printable ASCII, with some spaces like real text */
+static UChar random_char(){
+	int r = rand() % 100;
+	return r < 15 ? ' ' : (UChar)(33 + r % 94);
+}
+
+static void random_line(int row, int n){
+	int i;
+	put_csi("\033[%d;%dH", row, 1);
+	for(i = 0; i < n; ++i){
+		put_char(random_char());
+	}
+}
+
+static void fill_screen(){
+	int j;
+	for(j = 1; j <= rows; ++j){
+		/* leave the last column, so we never wrap */
+		random_line(j, cols - 1);
+	}
+}
+
+static void reset_screen(){
+	put_str("\033c\033[0m\033[2J\033[H");
+}
+
+/* every cell changes every frame */
+static void text_setup(){
+	reset_screen();
+}
+
+static void text_frame(int n){
+	fill_screen();
+}
+
+/* every cell changes every frame, each in its own 256 colour pair */
+static void color_setup(){
+	reset_screen();
+}
+
+static void color_frame(int n){
+	int i, j;
+	for(j = 1; j <= rows; ++j){
+		put_csi("\033[%d;%dH", j, 1);
+		for(i = 0; i < cols - 1; ++i){
+			put_csi("\033[38;5;%d;48;5;%dm", (i + j + n) % 256, (i * 7 + j * 3 + n) % 256);
+			put_char(random_char());
+		}
+	}
+	put_str("\033[0m");
+}
+
+/* a full screen scrolls up a line every frame */
+static void scroll_setup(){
+	reset_screen();
+	fill_screen();
+}
+
+static void scroll_frame(int n){
+	put_csi("\033[%d;%dH", rows, cols - 1);
+	put_str("\r\n");
+	random_line(rows, cols - 1);
+}
+
+/* a full screen that doesn't change, only the cursor moves */
+static void cursor_setup(){
+	reset_screen();
+	fill_screen();
+}
+
+static void cursor_frame(int n){
+	put_csi("\033[%d;%dH", 1 + rand() % rows, 1 + rand() % cols);
+}
+
+/* a screen of the 16 colours that doesn't change, while the palette
+ * under it does, as a colour scheme switch or visual bell would */
+static void palette_setup(){
+	int j;
+	reset_screen();
+	for(j = 1; j <= rows; ++j){
+		put_csi("\033[%d;%dm", 30 + j % 8, 40 + (j + 3) % 8);
+		random_line(j, cols - 1);
+	}
+	put_str("\033[0m");
+}
+
+static void palette_frame(int n){
+	char seq[64];
+	snprintf(seq, sizeof(seq), "\033]4;%d;rgb:%02x/%02x/%02x\033\\", n % 8, n & 0xff, (n * 3) & 0xff, (n * 7) & 0xff);
+	put_str(seq);
+}
+
+static struct workload workloads[] = {
+	{ "text", text_setup, text_frame },
+	{ "color", color_setup, color_frame },
+	{ "scroll", scroll_setup, scroll_frame },
+	{ "cursor", cursor_setup, cursor_frame },
+	{ "palette", palette_setup, palette_frame },
+	{ NULL, NULL, NULL }
+};
+
+static double seconds_since(struct timespec* start){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void put_be32(unsigned char* p, Uint32 v){
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void png_chunk(FILE* f, const char* type, const unsigned char* data, Uint32 len){
+	unsigned char head[8];
+	unsigned char tail[4];
+	uLong crc;
+	put_be32(head, len);
+	memcpy(head + 4, type, 4);
+	crc = crc32(0L, head + 4, 4);
+	if(len > 0){
+		crc = crc32(crc, data, len);
+	}
+	put_be32(tail, (Uint32)crc);
+	fwrite(head, 1, sizeof(head), f);
+	if(len > 0){
+		fwrite(data, 1, len, f);
+	}
+	fwrite(tail, 1, sizeof(tail), f);
+}
+
+/* Write surface out as an 8 bit RGB PNG */
+static int save_png(SDL_Surface* surface, const char* path){
+	int i, j;
+	size_t raw_len = (size_t)surface->h * (1 + 3 * surface->w);
+	uLongf z_len = compressBound(raw_len);
+	unsigned char* raw = (unsigned char*)malloc(raw_len);
+	unsigned char* z = (unsigned char*)malloc(z_len);
+	unsigned char ihdr[13];
+	FILE* f;
+
+	if(raw == NULL || z == NULL){
+		free(raw);
+		free(z);
+		return TERM_FAILURE;
+	}
+	unsigned char* p = raw;
+	for(j = 0; j < surface->h; ++j){
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + j * surface->pitch);
+		*p++ = 0; /* no filter */
+		for(i = 0; i < surface->w; ++i){
+			SDL_GetRGB(row[i], surface->format, p, p + 1, p + 2);
+			p += 3;
+		}
+	}
+	if(compress2(z, &z_len, raw, raw_len, Z_DEFAULT_COMPRESSION) != Z_OK || (f = fopen(path, "wb")) == NULL){
+		free(raw);
+		free(z);
+		return TERM_FAILURE;
+	}
+	put_be32(ihdr, surface->w);
+	put_be32(ihdr + 4, surface->h);
+	ihdr[8] = 8;  /* bit depth */
+	ihdr[9] = 2;  /* RGB */
+	ihdr[10] = 0; /* deflate */
+	ihdr[11] = 0; /* adaptive filters */
+	ihdr[12] = 0; /* not interlaced */
+	fwrite("\211PNG\r\n\032\n", 1, 8, f);
+	png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+	png_chunk(f, "IDAT", z, (Uint32)z_len);
+	png_chunk(f, "IEND", NULL, 0);
+	fclose(f);
+	free(raw);
+	free(z);
+	return TERM_SUCCESS;
+}
+
+static void run_workload(struct workload* w, SDL_Surface* surface, int frames, const char* png_dir){
+	struct timespec start;
+	double parse_time = 0;
+	double render_time = 0;
+	int n;
+
+	srand(1);
+	w->setup();
+	flush_text();
+	render();
+	for(n = 0; n < BENCH_WARMUP; ++n){
+		w->frame(n);
+		flush_text();
+		render();
+	}
+	for(n = 0; n < frames; ++n){
+		w->frame(n);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		flush_text();
+		parse_time += seconds_since(&start);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		render();
+		render_time += seconds_since(&start);
+	}
+	printf("%-8s %5d frames %9.1f fps %9.1f ns/cell %7.2f ms/frame parsing\n",
+	       w->name, frames, frames / render_time,
+	       render_time * 1e9 / ((double)frames * rows * cols),
+	       parse_time * 1e3 / frames);
+
+	if(png_dir != NULL){
+		char path[1024];
+		snprintf(path, sizeof(path), "%s/%s.png", png_dir, w->name);
+		if(save_png(surface, path) == TERM_FAILURE){
+			fprintf(stderr, "Couldn't write %s\n", path);
+		}
+	}
+}
+
+/* The surface path: render a one character string, copy it to the mask */
+static void glyph_by_surface(TTF_Font* font, UChar32 c, Uint8* mask, int pitch, int w, int h){
+	static const SDL_Color white = {255, 255, 255, 0};
+	static const SDL_Color black = {0, 0, 0, 0};
+	Uint16 str[2] = {(Uint16)c, 0};
+	SDL_Surface* glyph = TTF_RenderUNICODE_Shaded(font, str, white, black);
+	if(glyph == NULL){
+		return;
+	}
+	int copy_w = glyph->w < w ? glyph->w : w;
+	int copy_h = glyph->h < h ? glyph->h : h;
+	memset(mask, 0, (size_t)pitch * h);
+	for(int y = 0; y < copy_h; ++y){
+		memcpy(mask + y * pitch, (Uint8*)glyph->pixels + y * glyph->pitch, copy_w);
+	}
+	SDL_FreeSurface(glyph);
+}
+
+static void glyph_by_cell(TTF_Font* font, UChar32 c, Uint8* mask, int pitch, int w, int h){
+	memset(mask, 0, (size_t)pitch * h);
+	TTF_RenderGlyph_Cell(font, (Uint32)c, mask, pitch, w, h);
+}
+
+/* Time rasterizing printable ASCII into a cell mask through a surface,
+ * against TTF_RenderGlyph_Cell(), and check they draw the same thing.
+ * Both come from SDL_ttf's glyph cache, so this is the cost of getting a
+ * cached glyph into a mask. The surface path allocates a surface for every
+ * glyph, so its time depends on the SDL it is linked against as much as on
+ * the font. */
+static void run_glyph_bench(const char* font_path, int styles){
+	struct timespec start;
+	double by_surface = 0, by_cell = 0;
+	int minx, maxx, miny, maxy, advance;
+	int differ = 0;
+	UChar32 c;
+
+	TTF_Font* font = TTF_OpenFont(font_path, DEFAULT_FONT_SIZE);
+	if(font == NULL){
+		fprintf(stderr, "Couldn't load font %s: %s\n", font_path, TTF_GetError());
+		return;
+	}
+	TTF_SetFontKerning(font, 0);
+	TTF_SetFontHinting(font, TTF_HINTING_NORMAL);
+	TTF_SetFontStyle(font, styles);
+	TTF_GlyphMetrics(font, 'X', &minx, &maxx, &miny, &maxy, &advance);
+	int w = 2 * advance;
+	int h = TTF_FontLineSkip(font);
+	Uint8* a = (Uint8*)malloc((size_t)w * h);
+	Uint8* b = (Uint8*)malloc((size_t)w * h);
+	if(a == NULL || b == NULL){
+		free(a);
+		free(b);
+		TTF_CloseFont(font);
+		return;
+	}
+
+	for(c = '!'; c <= '~'; ++c){
+		glyph_by_surface(font, c, a, w, w, h);
+		glyph_by_cell(font, c, b, w, w, h);
+		differ += memcmp(a, b, (size_t)w * h) != 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int r = 0; r < BENCH_GLYPH_ROUNDS; ++r){
+		for(c = '!'; c <= '~'; ++c){
+			glyph_by_surface(font, c, a, w, w, h);
+		}
+	}
+	by_surface = seconds_since(&start);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int r = 0; r < BENCH_GLYPH_ROUNDS; ++r){
+		for(c = '!'; c <= '~'; ++c){
+			glyph_by_cell(font, c, b, w, w, h);
+		}
+	}
+	by_cell = seconds_since(&start);
+
+	double glyphs = (double)BENCH_GLYPH_ROUNDS * ('~' - '!' + 1);
+	printf("%-8s %dpt %dx%d cells, style %d: surface %7.0f ns/glyph, cell %7.0f ns/glyph, %.1fx, %d of %d differ\n",
+	       "glyphs", DEFAULT_FONT_SIZE, advance, h, styles, by_surface * 1e9 / glyphs, by_cell * 1e9 / glyphs,
+	       by_surface / by_cell, differ, '~' - '!' + 1);
+	free(a);
+	free(b);
+	TTF_CloseFont(font);
+}
+
+/* Check a combining mark shows: the cell of an e with U+0301 on it has to
+ * come out different from the cell of a plain e. Returns TERM_FAILURE if
+ * the mark was lost. */
+static int run_mark_check(SDL_Surface* surface){
+	int differ = 0;
+	reset_screen();
+	put_str("e e");
+	put_char(0x0301);
+	flush_text();
+	render();
+	for(int y = 0; y < text_height && !differ; ++y){
+		Uint32* row = (Uint32*)((Uint8*)surface->pixels + y * surface->pitch);
+		differ = memcmp(row, row + 2 * text_width, text_width * sizeof(Uint32)) != 0;
+	}
+	printf("%-8s e and e+U+0301 %s\n", "marks", differ ? "differ" : "are the same");
+	return differ ? TERM_SUCCESS : TERM_FAILURE;
+}
+
+static void usage(){
+	struct workload* w;
+	fprintf(stderr, "usage: renderbench [-s WIDTHxHEIGHT] [-n FRAMES] [-o PNG_DIR] [-f FONT] [WORKLOAD...]\n");
+	fprintf(stderr, "workloads: glyphs marks");
+	for(w = workloads; w->name != NULL; ++w){
+		fprintf(stderr, " %s", w->name);
+	}
+	fprintf(stderr, "\n");
+}
+
+static int selected(const char* name, int argc, char** argv, int first){
+	int i;
+	if(first >= argc){
+		return 1;
+	}
+	for(i = first; i < argc; ++i){
+		if(strcmp(argv[i], name) == 0){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char** argv){
+	int width = BENCH_WIDTH;
+	int height = BENCH_HEIGHT;
+	int frames = BENCH_FRAMES;
+	const char* png_dir = NULL;
+	const char* font_path = DEFAULT_FONT_PATH;
+	char size[32];
+	struct workload* w;
+	int rc = TERM_SUCCESS;
+	int i;
+
+	for(i = 1; i < argc && argv[i][0] == '-'; ++i){
+		if(strcmp(argv[i], "-s") == 0 && i + 1 < argc){
+			if(sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0){
+				usage();
+				return TERM_FAILURE;
+			}
+		} else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+			frames = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc){
+			png_dir = argv[++i];
+		} else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc){
+			font_path = argv[++i];
+			prefs->font_path = (char*)font_path;
+		} else {
+			usage();
+			return TERM_FAILURE;
+		}
+	}
+	if(frames <= 0){
+		usage();
+		return TERM_FAILURE;
+	}
+	for(w = workloads; w->name != NULL; ++w){
+		if(selected(w->name, argc, argv, i)){
+			break;
+		}
+	}
+	/* glyphs and marks only run when asked for */
+	char glyphs = i < argc && selected("glyphs", argc, argv, i);
+	char marks = i < argc && selected("marks", argc, argv, i);
+	if(w->name == NULL && !glyphs && !marks){
+		usage();
+		return TERM_FAILURE;
+	}
+
+	/* the preferences and fonts size themselves from these */
+	snprintf(size, sizeof(size), "%d", width);
+	setenv("WIDTH", size, 1);
+	snprintf(size, sizeof(size), "%d", height);
+	setenv("HEIGHT", size, 1);
+
+	SDL_Surface* surface = bench_init(width, height);
+	if(surface == NULL){
+		fprintf(stderr, "Couldn't set up the renderer\n");
+		return TERM_FAILURE;
+	}
+
+	/* enough for a full screen of colour cells */
+	text_size = (size_t)(rows + 1) * (cols + 1) * 32;
+	text = (UChar*)malloc(text_size * sizeof(UChar));
+	if(text == NULL){
+		fprintf(stderr, "Couldn't allocate workload text\n");
+		return TERM_FAILURE;
+	}
+
+	printf("%dx%d pixels, %d rows x %d cols\n", width, height, rows, cols);
+	if(glyphs){
+		run_glyph_bench(font_path, TTF_STYLE_NORMAL);
+		run_glyph_bench(font_path, TTF_STYLE_BOLD);
+	}
+	if(marks){
+		rc = run_mark_check(surface);
+	}
+	for(w = workloads; w->name != NULL; ++w){
+		if(selected(w->name, argc, argv, i)){
+			run_workload(w, surface, frames, png_dir);
+		}
+	}
+	free(text);
+	return rc;
+}
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2013 Todd Mortimer
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Generates src/charwidth.c, the two level character width table used by
+# char_width() in src/charwidth.h.
+#
+# The code space is split into blocks of 256 code points. The first stage
+# maps (c >> 8) to a block number, and the second stage holds the widths
+# for each distinct block, packed 4 to a byte. Most blocks are identical
+# (all narrow, or all wide for the CJK ideographs), so the whole table is
+# only a few kB.
+#
+# Usage: scripts/gen-charwidth.py > src/charwidth.c
+
+import sys
+import unicodedata
+
+MAX_CODEPOINT = 0x110000
+BLOCK_SHIFT = 8
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+
+# unassigned code points in these ranges default to wide
+# (see the header of EastAsianWidth.txt)
+WIDE_RANGES = [
+    (0x3400, 0x4DBF),
+    (0x4E00, 0x9FFF),
+    (0xF900, 0xFAFF),
+    (0x20000, 0x2FFFD),
+    (0x30000, 0x3FFFD),
+]
+
+
+def width(c):
+    if c == 0x00AD:
+        # SOFT HYPHEN is printed
+        return 1
+    if 0x1160 <= c <= 0x11FF or c == 0x200B:
+        # Hangul medial vowels and final consonants, ZERO WIDTH SPACE
+        return 0
+    ch = chr(c)
+    category = unicodedata.category(ch)
+    if category in ('Mn', 'Me', 'Cf'):
+        return 0
+    if category == 'Cn':
+        for lo, hi in WIDE_RANGES:
+            if lo <= c <= hi:
+                return 2
+        return 1
+    if unicodedata.east_asian_width(ch) in ('W', 'F'):
+        return 2
+    return 1
+
+
+def main():
+    stage1 = []
+    blocks = []
+    index = {}
+    for base in range(0, MAX_CODEPOINT, BLOCK_SIZE):
+        packed = bytearray(BLOCK_SIZE // 4)
+        for i in range(BLOCK_SIZE):
+            packed[i >> 2] |= width(base + i) << ((i & 3) << 1)
+        packed = bytes(packed)
+        if packed not in index:
+            index[packed] = len(blocks)
+            blocks.append(packed)
+        stage1.append(index[packed])
+
+    if len(blocks) > 256:
+        sys.exit("too many distinct blocks for an 8 bit stage 1 table")
+
+    out = sys.stdout
+    out.write("/* Generated by scripts/gen-charwidth.py from Unicode %s - do not edit */\n\n"
+              % unicodedata.unidata_version)
+    out.write('#include "charwidth.h"\n\n')
+    out.write("const unsigned char charwidth_stage1[%d] = {\n" % len(stage1))
+    for i in range(0, len(stage1), 16):
+        out.write("  " + ",".join("%3d" % b for b in stage1[i:i + 16]) + ",\n")
+    out.write("};\n\n")
+    out.write("const unsigned char charwidth_stage2[%d][%d] = {\n" % (len(blocks), BLOCK_SIZE // 4))
+    for n, block in enumerate(blocks):
+        out.write("  { /* %d */\n" % n)
+        for i in range(0, len(block), 16):
+            out.write("    " + ",".join("0x%02x" % b for b in block[i:i + 16]) + ",\n")
+        out.write("  },\n")
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
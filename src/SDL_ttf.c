@@ -41,6 +41,7 @@
 #include FT_OUTLINE_H
 #include FT_STROKER_H
 #include FT_GLYPH_H
+#include FT_SIZES_H
 #include FT_TRUETYPE_IDS_H
 
 #include "SDL.h"
@@ -60,6 +61,11 @@
 #define CACHED_BITMAP	0x01
 #define CACHED_PIXMAP	0x02
 
+/* The glyph cache is set associative: a code point hashes to a set of
+   TTF_CACHE_WAYS glyphs, and a miss replaces the least recently used
+   glyph in its set. */
+#define TTF_CACHE_WAYS	8
+
 /* Cached glyph information */
 typedef struct cached_glyph {
 	int stored;
@@ -72,14 +78,41 @@ typedef struct cached_glyph {
 	int maxy;
 	int yoffset;
 	int advance;
-	Uint16 cached;
+	Uint32 cached;	/* the code point held here */
+	Uint32 last_used;	/* 0 if the entry is empty */
 } c_glyph;
 
+/* A size the font was set to before, with its metrics and glyphs, kept
+   so that setting it again doesn't start from an empty cache */
+typedef struct kept_size {
+	int ptsize;	/* 0 if the slot is empty */
+	FT_Size size;
+	int height;
+	int ascent;
+	int descent;
+	int lineskip;
+	int glyph_overhang;
+	float glyph_italics;
+	int underline_offset;
+	int underline_height;
+	int font_size_family;
+	c_glyph *cache;
+	int cache_sets;
+	int cache_shift;
+	Uint32 cache_clock;
+	Uint32 last_used;
+} kept_size;
+
 /* The structure used to hold internal font information */
 struct _TTF_Font {
 	/* Freetype2 maintains all sorts of useful info itself */
 	FT_Face face;
 
+	/* The library the face was opened with, and whether it is the
+	   font's own, from TTF_OpenFontPrivate() */
+	FT_Library library;
+	int own_library;
+
 	/* We'll cache these ourselves */
 	int height;
 	int ascent;
@@ -104,7 +137,13 @@ struct _TTF_Font {
 
 	/* Cache for style-transformed glyphs */
 	c_glyph *current;
-	c_glyph cache[257]; /* 257 is a prime */
+	c_glyph *cache;
+	int cache_sets;	/* a power of 2, at least 2 */
+	int cache_shift;	/* 32 - log2(cache_sets) */
+	Uint32 cache_clock;
+	unsigned long cache_hits;
+	unsigned long cache_misses;
+	unsigned long cache_evictions;
 
 	/* We are responsible for closing the font stream */
 	SDL_RWops *src;
@@ -113,6 +152,12 @@ struct _TTF_Font {
 
 	/* For non-scalable formats, we must remember which font index size */
 	int font_size_family;
+
+	/* The size the font is set to, and the sizes it was set to before,
+	   least recently used first out */
+	int ptsize;
+	kept_size kept[TTF_KEPT_SIZES];
+	Uint32 size_clock;
 	
 	/* really just flags passed into FT_Load_Glyph */
 	int hinting;
@@ -129,6 +174,8 @@ struct _TTF_Font {
 /* Font styles that does not impact glyph drawing */
 #define TTF_STYLE_NO_GLYPH_CHANGE	(TTF_STYLE_UNDERLINE | TTF_STYLE_STRIKETHROUGH)
 
+static int Alloc_Cache( TTF_Font* font, int size );
+
 /* The FreeType font engine/library */
 static FT_Library library;
 static int TTF_initialized = 0;
@@ -369,21 +416,77 @@ static unsigned long RWread(
 	return SDL_RWread( src, buffer, 1, (int)count );
 }
 
-TTF_Font* TTF_OpenFontIndexRW( SDL_RWops *src, int freesrc, int ptsize, long index )
+/* Set the size of the glyphs and the font metrics that go with it */
+static int Set_Font_Size( TTF_Font* font, int ptsize )
+{
+	FT_Face face = font->face;
+	FT_Fixed scale;
+	FT_Error error;
+
+	/* Make sure that our font face is scalable (global metrics) */
+	if ( FT_IS_SCALABLE(face) ) {
+
+	  	/* Set the character size and use default DPI (72) */
+	  	error = FT_Set_Char_Size( font->face, 0, ptsize * 64, 0, 0 );
+			if( error ) {
+	    	TTF_SetFTError( "Couldn't set font size", error );
+	    	return -1;
+	  }
+
+	  /* Get the scalable font metrics for this font */
+	  scale = face->size->metrics.y_scale;
+	  font->ascent  = FT_CEIL(FT_MulFix(face->ascender, scale));
+	  font->descent = FT_CEIL(FT_MulFix(face->descender, scale));
+	  font->height  = font->ascent - font->descent + /* baseline */ 1;
+	  font->lineskip = FT_CEIL(FT_MulFix(face->height, scale));
+	  font->underline_offset = FT_FLOOR(FT_MulFix(face->underline_position, scale));
+	  font->underline_height = FT_FLOOR(FT_MulFix(face->underline_thickness, scale));
+
+	} else {
+		/* Non-scalable font case.  ptsize determines which family
+		 * or series of fonts to grab from the non-scalable format.
+		 * It is not the point size of the font.
+		 * */
+		if ( ptsize >= font->face->num_fixed_sizes )
+			ptsize = font->face->num_fixed_sizes - 1;
+		font->font_size_family = ptsize;
+		error = FT_Set_Pixel_Sizes( face,
+				face->available_sizes[ptsize].height,
+				face->available_sizes[ptsize].width );
+	  	/* With non-scalale fonts, Freetype2 likes to fill many of the
+		 * font metrics with the value of 0.  The size of the
+		 * non-scalable fonts must be determined differently
+		 * or sometimes cannot be determined.
+		 * */
+	  	font->ascent = face->available_sizes[ptsize].height;
+	  	font->descent = 0;
+	  	font->height = face->available_sizes[ptsize].height;
+	  	font->lineskip = FT_CEIL(font->ascent);
+	  	font->underline_offset = FT_FLOOR(face->underline_position);
+	  	font->underline_height = FT_FLOOR(face->underline_thickness);
+	}
+
+	if ( font->underline_height < 1 ) {
+		font->underline_height = 1;
+	}
+
+	font->glyph_overhang = face->size->metrics.y_ppem / 10;
+	/* x offset = cos(((90.0-12)/360)*2*M_PI), or 12 degree angle */
+	font->glyph_italics = 0.207f;
+	font->glyph_italics *= font->height;
+
+	return 0;
+}
+
+static TTF_Font* Open_Font( FT_Library lib, SDL_RWops *src, int freesrc, int ptsize, long index )
 {
 	TTF_Font* font;
 	FT_Error error;
 	FT_Face face;
-	FT_Fixed scale;
 	FT_Stream stream;
 	FT_CharMap found;
 	int position, i;
 
-	if ( ! TTF_initialized ) {
-		TTF_SetError( "Library not initialized" );
-		return NULL;
-	}
-
 	/* Check to make sure we can seek in this stream */
 	position = SDL_RWtell(src);
 	if ( position < 0 ) {
@@ -400,6 +503,13 @@ TTF_Font* TTF_OpenFontIndexRW( SDL_RWops *src, int freesrc, int ptsize, long ind
 
 	font->src = src;
 	font->freesrc = freesrc;
+	font->library = lib;
+
+	if ( Alloc_Cache( font, TTF_DEFAULT_CACHE_SIZE ) < 0 ) {
+		TTF_SetError( "Out of memory" );
+		TTF_CloseFont( font );
+		return NULL;
+	}
 
 	stream = (FT_Stream)malloc(sizeof(*stream));
 	if ( stream == NULL ) {
@@ -419,7 +529,7 @@ TTF_Font* TTF_OpenFontIndexRW( SDL_RWops *src, int freesrc, int ptsize, long ind
 	font->args.flags = FT_OPEN_STREAM;
 	font->args.stream = stream;
 
-	error = FT_Open_Face( library, &font->args, index, &font->face );
+	error = FT_Open_Face( font->library, &font->args, index, &font->face );
 	if( error ) {
 		TTF_SetFTError( "Couldn't load font file", error );
 		TTF_CloseFont( font );
@@ -444,52 +554,10 @@ TTF_Font* TTF_OpenFontIndexRW( SDL_RWops *src, int freesrc, int ptsize, long ind
 		FT_Set_Charmap(face, found);
 	}
 
-	/* Make sure that our font face is scalable (global metrics) */
-	if ( FT_IS_SCALABLE(face) ) {
-
-	  	/* Set the character size and use default DPI (72) */
-	  	error = FT_Set_Char_Size( font->face, 0, ptsize * 64, 0, 0 );
-			if( error ) {
-	    	TTF_SetFTError( "Couldn't set font size", error );
-	    	TTF_CloseFont( font );
-	    	return NULL;
-	  }
-
-	  /* Get the scalable font metrics for this font */
-	  scale = face->size->metrics.y_scale;
-	  font->ascent  = FT_CEIL(FT_MulFix(face->ascender, scale));
-	  font->descent = FT_CEIL(FT_MulFix(face->descender, scale));
-	  font->height  = font->ascent - font->descent + /* baseline */ 1;
-	  font->lineskip = FT_CEIL(FT_MulFix(face->height, scale));
-	  font->underline_offset = FT_FLOOR(FT_MulFix(face->underline_position, scale));
-	  font->underline_height = FT_FLOOR(FT_MulFix(face->underline_thickness, scale));
-
-	} else {
-		/* Non-scalable font case.  ptsize determines which family
-		 * or series of fonts to grab from the non-scalable format.
-		 * It is not the point size of the font.
-		 * */
-		if ( ptsize >= font->face->num_fixed_sizes )
-			ptsize = font->face->num_fixed_sizes - 1;
-		font->font_size_family = ptsize;
-		error = FT_Set_Pixel_Sizes( face,
-				face->available_sizes[ptsize].height,
-				face->available_sizes[ptsize].width );
-	  	/* With non-scalale fonts, Freetype2 likes to fill many of the
-		 * font metrics with the value of 0.  The size of the
-		 * non-scalable fonts must be determined differently
-		 * or sometimes cannot be determined.
-		 * */
-	  	font->ascent = face->available_sizes[ptsize].height;
-	  	font->descent = 0;
-	  	font->height = face->available_sizes[ptsize].height;
-	  	font->lineskip = FT_CEIL(font->ascent);
-	  	font->underline_offset = FT_FLOOR(face->underline_position);
-	  	font->underline_height = FT_FLOOR(face->underline_thickness);
-	}
-
-	if ( font->underline_height < 1 ) {
-		font->underline_height = 1;
+	font->ptsize = ptsize;
+	if ( Set_Font_Size( font, ptsize ) < 0 ) {
+		TTF_CloseFont( font );
+		return NULL;
 	}
 
 #ifdef DEBUG_FONTS
@@ -516,14 +584,19 @@ TTF_Font* TTF_OpenFontIndexRW( SDL_RWops *src, int freesrc, int ptsize, long ind
 	font->style = font->face_style;
 	font->outline = 0;
 	font->kerning = 1;
-	font->glyph_overhang = face->size->metrics.y_ppem / 10;
-	/* x offset = cos(((90.0-12)/360)*2*M_PI), or 12 degree angle */
-	font->glyph_italics = 0.207f;
-	font->glyph_italics *= font->height;
 
 	return font;
 }
 
+TTF_Font* TTF_OpenFontIndexRW( SDL_RWops *src, int freesrc, int ptsize, long index )
+{
+	if ( ! TTF_initialized ) {
+		TTF_SetError( "Library not initialized" );
+		return NULL;
+	}
+	return Open_Font(library, src, freesrc, ptsize, index);
+}
+
 TTF_Font* TTF_OpenFontRW( SDL_RWops *src, int freesrc, int ptsize )
 {
 	return TTF_OpenFontIndexRW(src, freesrc, ptsize, 0);
@@ -544,6 +617,33 @@ TTF_Font* TTF_OpenFont( const char *file, int ptsize )
 	return TTF_OpenFontIndex(file, ptsize, 0);
 }
 
+TTF_Font* TTF_OpenFontPrivate( const char *file, int ptsize )
+{
+	FT_Library lib;
+	FT_Error error;
+	TTF_Font* font;
+	SDL_RWops *rw;
+
+	error = FT_Init_FreeType( &lib );
+	if ( error ) {
+		TTF_SetFTError( "Couldn't init FreeType engine", error );
+		return NULL;
+	}
+	rw = SDL_RWFromFile(file, "rb");
+	if ( rw == NULL ) {
+		TTF_SetError(SDL_GetError());
+		FT_Done_FreeType( lib );
+		return NULL;
+	}
+	font = Open_Font(lib, rw, 1, ptsize, 0);
+	if ( font == NULL ) {
+		FT_Done_FreeType( lib );
+		return NULL;
+	}
+	font->own_library = 1;
+	return font;
+}
+
 static void Flush_Glyph( c_glyph* glyph )
 {
 	glyph->stored = 0;
@@ -557,22 +657,71 @@ static void Flush_Glyph( c_glyph* glyph )
 		glyph->pixmap.buffer = 0;
 	}
 	glyph->cached = 0;
+	glyph->last_used = 0;
 }
 	
-static void Flush_Cache( TTF_Font* font )
+static void Flush_Glyphs( c_glyph* cache, int size )
 {
 	int i;
-	int size = sizeof( font->cache ) / sizeof( font->cache[0] );
 
 	for( i = 0; i < size; ++i ) {
-		if( font->cache[i].cached ) {
-			Flush_Glyph( &font->cache[i] );
+		if( cache[i].last_used ) {
+			Flush_Glyph( &cache[i] );
 		}
 
 	}
 }
 
-static FT_Error Load_Glyph( TTF_Font* font, Uint16 ch, c_glyph* cached, int want )
+static void Flush_Cache( TTF_Font* font )
+{
+	Flush_Glyphs( font->cache, font->cache_sets * TTF_CACHE_WAYS );
+	font->current = NULL;
+}
+
+/* Drop the glyphs of the kept sizes, when a change of style or hinting
+   makes them stale. The sizes themselves are kept. */
+static void Flush_Kept_Sizes( TTF_Font* font )
+{
+	int i;
+
+	for( i = 0; i < TTF_KEPT_SIZES; ++i ) {
+		if( font->kept[i].ptsize ) {
+			Flush_Glyphs( font->kept[i].cache,
+				font->kept[i].cache_sets * TTF_CACHE_WAYS );
+			font->kept[i].cache_clock = 0;
+		}
+	}
+}
+
+/* Replace the glyph cache of font with an empty one holding at least
+   size glyphs */
+static int Alloc_Cache( TTF_Font* font, int size )
+{
+	int sets = 2;
+	int shift = 31;
+	c_glyph *cache;
+
+	while ( sets * TTF_CACHE_WAYS < size ) {
+		sets <<= 1;
+		--shift;
+	}
+	cache = (c_glyph *)calloc( sets * TTF_CACHE_WAYS, sizeof(c_glyph) );
+	if ( cache == NULL ) {
+		return -1;
+	}
+	if ( font->cache ) {
+		Flush_Cache( font );
+		free( font->cache );
+	}
+	font->cache = cache;
+	font->cache_sets = sets;
+	font->cache_shift = shift;
+	font->cache_clock = 0;
+	font->current = NULL;
+	return 0;
+}
+
+static FT_Error Load_Glyph( TTF_Font* font, Uint32 ch, c_glyph* cached, int want )
 {
 	FT_Face face;
 	FT_Error error;
@@ -659,7 +808,7 @@ static FT_Error Load_Glyph( TTF_Font* font, Uint16 ch, c_glyph* cached, int want
 		if( (font->outline > 0) && glyph->format != FT_GLYPH_FORMAT_BITMAP ) {
 			FT_Stroker stroker;
 			FT_Get_Glyph( glyph, &bitmap_glyph );
-			error = FT_Stroker_New( library, &stroker );
+			error = FT_Stroker_New( font->library, &stroker );
 			if( error ) {
 				return error;
 			}
@@ -886,16 +1035,48 @@ static FT_Error Load_Glyph( TTF_Font* font, Uint16 ch, c_glyph* cached, int want
 	return 0;
 }
 
-static FT_Error Find_Glyph( TTF_Font* font, Uint16 ch, int want )
+static FT_Error Find_Glyph( TTF_Font* font, Uint32 ch, int want )
 {
 	int retval = 0;
-	int hsize = sizeof( font->cache ) / sizeof( font->cache[0] );
+	int i;
+	c_glyph *set;
+	c_glyph *victim;
+
+	/* Fibonacci hashing spreads runs of code points across the sets */
+	set = &font->cache[((Uint32)(ch * 2654435761u) >> font->cache_shift) * TTF_CACHE_WAYS];
 
-	int h = ch % hsize;
-	font->current = &font->cache[h];
+	if ( ++font->cache_clock == 0 ) {
+		/* The clock wrapped, age everything equally */
+		for ( i = 0; i < font->cache_sets * TTF_CACHE_WAYS; ++i ) {
+			if ( font->cache[i].last_used ) {
+				font->cache[i].last_used = 1;
+			}
+		}
+		font->cache_clock = 2;
+	}
 
-	if (font->current->cached != ch)
-		Flush_Glyph( font->current );
+	victim = &set[0];
+	for ( i = 0; i < TTF_CACHE_WAYS; ++i ) {
+		if ( set[i].last_used && set[i].cached == ch ) {
+			break;
+		}
+		if ( set[i].last_used < victim->last_used ) {
+			victim = &set[i];
+		}
+	}
+
+	if ( i < TTF_CACHE_WAYS ) {
+		font->current = &set[i];
+		++font->cache_hits;
+	} else {
+		if ( victim->last_used ) {
+			Flush_Glyph( victim );
+			++font->cache_evictions;
+		}
+		font->current = victim;
+		++font->cache_misses;
+	}
+	font->current->last_used = font->cache_clock;
 
 	if ( (font->current->stored & want) != want ) {
 		retval = Load_Glyph( font, ch, font->current, want );
@@ -903,10 +1084,178 @@ static FT_Error Find_Glyph( TTF_Font* font, Uint16 ch, int want )
 	return retval;
 }
 
+void TTF_SetFontCacheSize( TTF_Font* font, int size )
+{
+	if ( Alloc_Cache( font, size ) < 0 ) {
+		TTF_SetError( "Out of memory" );
+	}
+}
+
+int TTF_GetFontCacheSize( const TTF_Font* font )
+{
+	return font->cache_sets * TTF_CACHE_WAYS;
+}
+
+/* Copy the size font is set to into k */
+static void Save_Size( TTF_Font* font, kept_size* k )
+{
+	k->ptsize = font->ptsize;
+	k->size = font->face->size;
+	k->height = font->height;
+	k->ascent = font->ascent;
+	k->descent = font->descent;
+	k->lineskip = font->lineskip;
+	k->glyph_overhang = font->glyph_overhang;
+	k->glyph_italics = font->glyph_italics;
+	k->underline_offset = font->underline_offset;
+	k->underline_height = font->underline_height;
+	k->font_size_family = font->font_size_family;
+	k->cache = font->cache;
+	k->cache_sets = font->cache_sets;
+	k->cache_shift = font->cache_shift;
+	k->cache_clock = font->cache_clock;
+	k->last_used = ++font->size_clock;
+}
+
+/* Set font to the size saved in k, which is left empty */
+static void Restore_Size( TTF_Font* font, kept_size* k )
+{
+	FT_Activate_Size( k->size );
+	font->ptsize = k->ptsize;
+	font->height = k->height;
+	font->ascent = k->ascent;
+	font->descent = k->descent;
+	font->lineskip = k->lineskip;
+	font->glyph_overhang = k->glyph_overhang;
+	font->glyph_italics = k->glyph_italics;
+	font->underline_offset = k->underline_offset;
+	font->underline_height = k->underline_height;
+	font->font_size_family = k->font_size_family;
+	font->cache = k->cache;
+	font->cache_sets = k->cache_sets;
+	font->cache_shift = k->cache_shift;
+	font->cache_clock = k->cache_clock;
+	font->current = NULL;
+	k->ptsize = 0;
+	k->cache = NULL;
+}
+
+/* Free the glyphs of k, and its FreeType size if done_size is set.
+   FT_Done_Face() frees the sizes of a face itself. */
+static void Free_Kept_Size( kept_size* k, int done_size )
+{
+	Flush_Glyphs( k->cache, k->cache_sets * TTF_CACHE_WAYS );
+	free( k->cache );
+	if ( done_size ) {
+		FT_Done_Size( k->size );
+	}
+	k->ptsize = 0;
+	k->cache = NULL;
+}
+
+/* The size being left is kept, with its glyph cache, in place of the
+   least recently used kept size, so going back to it (as rotating
+   the screen back and forth does) costs no glyph renders. */
+int TTF_SetFontSize( TTF_Font* font, int ptsize )
+{
+	kept_size current;
+	kept_size *slot = NULL;
+	FT_Size size;
+	FT_Error error;
+	int i;
+
+	if ( ptsize == font->ptsize ) {
+		return 0;
+	}
+	Save_Size( font, &current );
+	for ( i = 0; i < TTF_KEPT_SIZES; ++i ) {
+		if ( font->kept[i].ptsize == ptsize ) {
+			slot = &font->kept[i];
+		}
+	}
+	if ( slot ) {
+		Restore_Size( font, slot );
+	} else {
+		error = FT_New_Size( font->face, &size );
+		if ( error ) {
+			TTF_SetFTError( "Couldn't create font size", error );
+			return -1;
+		}
+		FT_Activate_Size( size );
+		font->cache = NULL;
+		if ( Alloc_Cache( font, current.cache_sets * TTF_CACHE_WAYS ) < 0 ) {
+			TTF_SetError( "Out of memory" );
+			FT_Done_Size( size );
+			Restore_Size( font, &current );
+			return -1;
+		}
+		if ( Set_Font_Size( font, ptsize ) < 0 ) {
+			free( font->cache );
+			FT_Done_Size( size );
+			Restore_Size( font, &current );
+			return -1;
+		}
+		font->ptsize = ptsize;
+
+		/* an empty slot, or the least recently used one */
+		for ( i = 0; i < TTF_KEPT_SIZES; ++i ) {
+			if ( !slot || ( slot->ptsize &&
+			     ( !font->kept[i].ptsize || font->kept[i].last_used < slot->last_used ) ) ) {
+				slot = &font->kept[i];
+			}
+		}
+		if ( slot->ptsize ) {
+			Free_Kept_Size( slot, 1 );
+		}
+	}
+	*slot = current;
+	return 0;
+}
+
+void TTF_GetFontCacheStats( const TTF_Font* font, unsigned long* hits,
+                            unsigned long* misses, unsigned long* evictions )
+{
+	if ( hits ) {
+		*hits = font->cache_hits;
+	}
+	if ( misses ) {
+		*misses = font->cache_misses;
+	}
+	if ( evictions ) {
+		*evictions = font->cache_evictions;
+	}
+}
+
+/* Returns the code point at ch, joining a UTF-16 surrogate pair.
+   units is set to the number of Uint16s used. */
+static Uint32 UNICODE_char( const Uint16* ch, int swapped, int* units )
+{
+	Uint32 c = swapped ? SDL_Swap16(ch[0]) : ch[0];
+	*units = 1;
+	if ( c >= 0xD800 && c <= 0xDBFF && ch[1] ) {
+		Uint32 low = swapped ? SDL_Swap16(ch[1]) : ch[1];
+		if ( low >= 0xDC00 && low <= 0xDFFF ) {
+			c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+			*units = 2;
+		}
+	}
+	return c;
+}
+
 void TTF_CloseFont( TTF_Font* font )
 {
+	int i;
+
 	if ( font ) {
-		Flush_Cache( font );
+		if ( font->cache ) {
+			Flush_Cache( font );
+			free( font->cache );
+		}
+		for ( i = 0; i < TTF_KEPT_SIZES; ++i ) {
+			if ( font->kept[i].ptsize ) {
+				Free_Kept_Size( &font->kept[i], 0 );
+			}
+		}
 		if ( font->face ) {
 			FT_Done_Face( font->face );
 		}
@@ -916,6 +1265,9 @@ void TTF_CloseFont( TTF_Font* font )
 		if ( font->freesrc ) {
 			SDL_RWclose( font->src );
 		}
+		if ( font->own_library ) {
+			FT_Done_FreeType( font->library );
+		}
 		free( font );
 	}
 }
@@ -940,10 +1292,15 @@ static Uint16 *UTF8_to_UNICODE(Uint16 *unicode, const char *utf8, int len)
 	for ( i=0, j=0; i < len; ++i, ++j ) {
 		ch = ((const unsigned char *)utf8)[i];
 		if ( ch >= 0xF0 ) {
-			ch  =  (Uint16)(utf8[i]&0x07) << 18;
-			ch |=  (Uint16)(utf8[++i]&0x3F) << 12;
-			ch |=  (Uint16)(utf8[++i]&0x3F) << 6;
-			ch |=  (Uint16)(utf8[++i]&0x3F);
+			/* Outside the BMP, write a surrogate pair */
+			Uint32 ch32;
+			ch32  =  (Uint32)(utf8[i]&0x07) << 18;
+			ch32 |=  (Uint32)(utf8[++i]&0x3F) << 12;
+			ch32 |=  (Uint32)(utf8[++i]&0x3F) << 6;
+			ch32 |=  (Uint32)(utf8[++i]&0x3F);
+			ch32 -= 0x10000;
+			unicode[j++] = (Uint16)(0xD800 + (ch32 >> 10));
+			ch = (Uint16)(0xDC00 + (ch32 & 0x3FF));
 		} else
 		if ( ch >= 0xE0 ) {
 			ch  =  (Uint16)(utf8[i]&0x0F) << 12;
@@ -981,6 +1338,17 @@ int TTF_FontLineSkip(const TTF_Font *font)
 	return(font->lineskip);
 }
 
+void TTF_FontLineRows(const TTF_Font *font, int *underline_row, int *strikethrough_row, int *line_height)
+{
+	/* the rows the render functions draw their lines at */
+	*underline_row = TTF_underline_top_row((TTF_Font *)font);
+	*strikethrough_row = TTF_strikethrough_top_row((TTF_Font *)font);
+	*line_height = font->underline_height;
+	if( font->outline > 0 ) {
+		*line_height += font->outline * 2;
+	}
+}
+
 int TTF_GetFontKerning(const TTF_Font *font)
 {
 	return(font->kerning);
@@ -1001,6 +1369,15 @@ int TTF_FontFaceIsFixedWidth(const TTF_Font *font)
 	return(FT_IS_FIXED_WIDTH(font->face));
 }
 
+int TTF_FontHasColor(const TTF_Font *font)
+{
+#ifdef FT_HAS_COLOR
+	return(FT_HAS_COLOR(font->face));
+#else
+	return 0;
+#endif
+}
+
 char *TTF_FontFaceFamilyName(const TTF_Font *font)
 {
 	return(font->face->family_name);
@@ -1016,6 +1393,18 @@ int TTF_GlyphIsProvided(const TTF_Font *font, Uint16 ch)
   return(FT_Get_Char_Index(font->face, ch));
 }
 
+void TTF_FontCharacters(const TTF_Font *font, TTF_CharFunc fn, void *data)
+{
+	FT_UInt index;
+	FT_ULong ch;
+
+	ch = FT_Get_First_Char( font->face, &index );
+	while ( index != 0 ) {
+		fn( (Uint32)ch, data );
+		ch = FT_Get_Next_Char( font->face, ch, &index );
+	}
+}
+
 int TTF_GlyphMetrics(TTF_Font *font, Uint16 ch,
                      int* minx, int* maxx, int* miny, int* maxy, int* advance)
 {
@@ -1104,6 +1493,7 @@ int TTF_SizeUNICODE(TTF_Font *font, const Uint16 *text, int *w, int *h)
 	int status;
 	const Uint16 *ch;
 	int swapped;
+	int units;
 	int x, z;
 	int minx, maxx;
 	int miny, maxy;
@@ -1133,8 +1523,9 @@ int TTF_SizeUNICODE(TTF_Font *font, const Uint16 *text, int *w, int *h)
 
 	/* Load each character and sum it's bounding box */
 	x= 0;
-	for ( ch=text; *ch; ++ch ) {
-		Uint16 c = *ch;
+	for ( ch=text; *ch; ch += units ) {
+		Uint32 c = *ch;
+		units = 1;
 		if ( c == UNICODE_BOM_NATIVE ) {
 			swapped = 0;
 			if ( text == ch ) {
@@ -1149,9 +1540,7 @@ int TTF_SizeUNICODE(TTF_Font *font, const Uint16 *text, int *w, int *h)
 			}
 			continue;
 		}
-		if ( swapped ) {
-			c = SDL_Swap16(c);
-		}
+		c = UNICODE_char( ch, swapped, &units );
 
 		error = Find_Glyph(font, c, CACHED_METRICS);
 		if ( error ) {
@@ -1302,6 +1691,7 @@ SDL_Surface *TTF_RenderUNICODE_Solid(TTF_Font *font,
 	Uint8* dst;
 	Uint8 *dst_check;
 	int swapped;
+	int units;
 	int row, col;
 	c_glyph *glyph;
 
@@ -1342,8 +1732,9 @@ SDL_Surface *TTF_RenderUNICODE_Solid(TTF_Font *font,
 	/* Load and render each character */
 	xstart = 0;
 	swapped = TTF_byteswapped;
-	for( ch=text; *ch; ++ch ) {
-		Uint16 c = *ch;
+	for( ch=text; *ch; ch += units ) {
+		Uint32 c = *ch;
+		units = 1;
 		if ( c == UNICODE_BOM_NATIVE ) {
 			swapped = 0;
 			if ( text == ch ) {
@@ -1358,9 +1749,7 @@ SDL_Surface *TTF_RenderUNICODE_Solid(TTF_Font *font,
 			}
 			continue;
 		}
-		if ( swapped ) {
-			c = SDL_Swap16(c);
-		}
+		c = UNICODE_char( ch, swapped, &units );
 
 		error = Find_Glyph(font, c, CACHED_METRICS|CACHED_BITMAP);
 		if( error ) {
@@ -1567,6 +1956,7 @@ SDL_Surface* TTF_RenderUNICODE_Shaded( TTF_Font* font,
 	Uint8* dst;
 	Uint8* dst_check;
 	int swapped;
+	int units;
 	int row, col;
 	FT_Bitmap* current;
 	c_glyph *glyph;
@@ -1608,8 +1998,9 @@ SDL_Surface* TTF_RenderUNICODE_Shaded( TTF_Font* font,
 	/* Load and render each character */
 	xstart = 0;
 	swapped = TTF_byteswapped;
-	for( ch = text; *ch; ++ch ) {
-		Uint16 c = *ch;
+	for( ch = text; *ch; ch += units ) {
+		Uint32 c = *ch;
+		units = 1;
 		if ( c == UNICODE_BOM_NATIVE ) {
 			swapped = 0;
 			if ( text == ch ) {
@@ -1624,9 +2015,7 @@ SDL_Surface* TTF_RenderUNICODE_Shaded( TTF_Font* font,
 			}
 			continue;
 		}
-		if ( swapped ) {
-			c = SDL_Swap16(c);
-		}
+		c = UNICODE_char( ch, swapped, &units );
 
 		error = Find_Glyph(font, c, CACHED_METRICS|CACHED_PIXMAP);
 		if( error ) {
@@ -1691,6 +2080,199 @@ SDL_Surface* TTF_RenderUNICODE_Shaded( TTF_Font* font,
 	return textbuf;
 }
 
+/* Draw a line of underline_height (+ optional outline) at the given row
+   of a coverage buffer, w pixels long. */
+static void TTF_drawLine_Cell(const TTF_Font *font, Uint8 *buffer, int pitch, int w, int h, int row)
+{
+	int line;
+	int height = font->underline_height;
+	if( font->outline > 0 ) {
+		height += font->outline * 2;
+	}
+	if( row < 0 ) {
+		row = 0;
+	}
+	for ( line = row; line < row + height && line < h; ++line ) {
+		memset( buffer + line * pitch, NUM_GRAYS - 1, w );
+	}
+}
+
+int TTF_RenderGlyph_Cell( TTF_Font* font, Uint32 ch, Uint8* buffer, int pitch, int w, int h )
+{
+	int x;
+	int width;
+	int row, col;
+	Uint8* src;
+	Uint8* dst;
+	FT_Bitmap* current;
+	c_glyph *glyph;
+	FT_Error error;
+
+	error = Find_Glyph(font, ch, CACHED_METRICS|CACHED_PIXMAP);
+	if( error ) {
+		TTF_SetFTError("Couldn't find glyph", error);
+		return -1;
+	}
+	glyph = font->current;
+
+	/* the same clipping as the text surface of one character */
+	if( h > font->height ) {
+		h = font->height;
+	}
+	width = glyph->pixmap.width;
+	if (font->outline <= 0 && width > glyph->maxx - glyph->minx) {
+		width = glyph->maxx - glyph->minx;
+	}
+	/* a negative minx moves the glyph to the left edge */
+	x = glyph->minx < 0 ? 0 : glyph->minx;
+	if( x + width > w ) {
+		width = w - x;
+	}
+
+	current = &glyph->pixmap;
+	for( row = 0; row < current->rows; ++row ) {
+		if ( row+glyph->yoffset < 0 || row+glyph->yoffset >= h ) {
+			continue;
+		}
+		dst = buffer + (row+glyph->yoffset) * pitch + x;
+		src = current->buffer + row * current->pitch;
+		for ( col = 0; col < width; ++col ) {
+			dst[col] |= src[col];
+		}
+	}
+
+	/* lines run the width TTF_SizeUNICODE() gives the character */
+	width = glyph->advance > glyph->maxx ? glyph->advance : glyph->maxx;
+	if( TTF_HANDLE_STYLE_BOLD(font) ) {
+		width += font->glyph_overhang;
+	}
+	if( glyph->minx < 0 ) {
+		width -= glyph->minx;
+	}
+	if( width > w ) {
+		width = w;
+	}
+	if( TTF_HANDLE_STYLE_UNDERLINE(font) ) {
+		TTF_drawLine_Cell(font, buffer, pitch, width, h, TTF_underline_top_row(font));
+	}
+	if( TTF_HANDLE_STYLE_STRIKETHROUGH(font) ) {
+		TTF_drawLine_Cell(font, buffer, pitch, width, h, TTF_strikethrough_top_row(font));
+	}
+	return 0;
+}
+
+#ifdef FT_LOAD_COLOR
+/* The strike of a bitmap only font to draw h pixel high glyphs from:
+   the smallest one at least h high, or the biggest there is */
+static int Color_Strike( FT_Face face, int h )
+{
+	int i;
+	int best = 0;
+
+	for ( i = 1; i < face->num_fixed_sizes; ++i ) {
+		int size = face->available_sizes[i].height;
+		int best_size = face->available_sizes[best].height;
+		if ( best_size < h ? size > best_size : ( size >= h && size < best_size ) ) {
+			best = i;
+		}
+	}
+	return best;
+}
+#endif
+
+int TTF_RenderGlyph_Color( TTF_Font* font, Uint32 ch, Uint32* buffer, int pitch, int w, int h )
+{
+#ifdef FT_LOAD_COLOR
+	FT_Face face = font->face;
+	FT_Bitmap* bitmap;
+	FT_Error error;
+	FT_UInt index;
+	int strike = -1;
+	int dw, dh, ox, oy;
+	int x, y, sx, sy;
+
+	if ( !FT_HAS_COLOR(face) ) {
+		TTF_SetError( "Font has no colour glyphs" );
+		return -1;
+	}
+	index = FT_Get_Char_Index( face, ch );
+	if ( !index ) {
+		TTF_SetError( "Font doesn't have the glyph" );
+		return -1;
+	}
+	if ( !FT_IS_SCALABLE(face) && face->num_fixed_sizes > 0 ) {
+		strike = Color_Strike( face, h );
+		if ( strike == font->font_size_family ) {
+			strike = -1;
+		} else if ( FT_Select_Size( face, strike ) ) {
+			strike = -1;
+		}
+	}
+	error = FT_Load_Glyph( face, index, FT_LOAD_COLOR );
+	if ( !error && face->glyph->format != FT_GLYPH_FORMAT_BITMAP ) {
+		error = FT_Render_Glyph( face->glyph, FT_RENDER_MODE_NORMAL );
+	}
+	if ( error ) {
+		TTF_SetFTError( "Couldn't load colour glyph", error );
+		goto done;
+	}
+	bitmap = &face->glyph->bitmap;
+	if ( bitmap->pixel_mode != FT_PIXEL_MODE_BGRA || bitmap->width == 0 || bitmap->rows == 0 ) {
+		TTF_SetError( "Glyph has no colour bitmap" );
+		error = FT_Err_Invalid_Glyph_Format;
+		goto done;
+	}
+
+	/* fit it in w x h, keeping its shape, in the middle */
+	if ( bitmap->width * h > w * bitmap->rows ) {
+		dw = w;
+		dh = bitmap->rows * w / bitmap->width;
+	} else {
+		dh = h;
+		dw = bitmap->width * h / bitmap->rows;
+	}
+	if ( dw < 1 ) dw = 1;
+	if ( dh < 1 ) dh = 1;
+	ox = ( w - dw ) / 2;
+	oy = ( h - dh ) / 2;
+
+	/* each pixel is the average of the bitmap pixels under it */
+	for ( y = 0; y < dh; ++y ) {
+		int sy0 = y * bitmap->rows / dh;
+		int sy1 = ( y + 1 ) * bitmap->rows / dh;
+		if ( sy1 <= sy0 ) sy1 = sy0 + 1;
+		for ( x = 0; x < dw; ++x ) {
+			int sx0 = x * bitmap->width / dw;
+			int sx1 = ( x + 1 ) * bitmap->width / dw;
+			Uint32 b = 0, g = 0, r = 0, a = 0, n;
+			if ( sx1 <= sx0 ) sx1 = sx0 + 1;
+			for ( sy = sy0; sy < sy1; ++sy ) {
+				const Uint8* src = bitmap->buffer + sy * bitmap->pitch + sx0 * 4;
+				for ( sx = sx0; sx < sx1; ++sx, src += 4 ) {
+					b += src[0];
+					g += src[1];
+					r += src[2];
+					a += src[3];
+				}
+			}
+			n = ( sx1 - sx0 ) * ( sy1 - sy0 );
+			buffer[( y + oy ) * pitch + x + ox] =
+				( ( a + n / 2 ) / n ) << 24 | ( ( r + n / 2 ) / n ) << 16 |
+				( ( g + n / 2 ) / n ) << 8 | ( ( b + n / 2 ) / n );
+		}
+	}
+
+done:
+	if ( strike >= 0 ) {
+		FT_Select_Size( face, font->font_size_family );
+	}
+	return error ? -1 : 0;
+#else
+	TTF_SetError( "FreeType was built without colour glyphs" );
+	return -1;
+#endif
+}
+
 SDL_Surface* TTF_RenderGlyph_Shaded( TTF_Font* font,
 				     Uint16 ch,
 				     SDL_Color fg,
@@ -1834,6 +2416,7 @@ SDL_Surface *TTF_RenderUNICODE_Blended(TTF_Font *font,
 	Uint32 *dst;
 	Uint32 *dst_check;
 	int swapped;
+	int units;
 	int row, col;
 	c_glyph *glyph;
 	FT_Error error;
@@ -1866,8 +2449,9 @@ SDL_Surface *TTF_RenderUNICODE_Blended(TTF_Font *font,
 	pixel = (fg.r<<16)|(fg.g<<8)|fg.b;
 	SDL_FillRect(textbuf, NULL, pixel);	/* Initialize with fg and 0 alpha */
 
-	for ( ch=text; *ch; ++ch ) {
-		Uint16 c = *ch;
+	for ( ch=text; *ch; ch += units ) {
+		Uint32 c = *ch;
+		units = 1;
 		if ( c == UNICODE_BOM_NATIVE ) {
 			swapped = 0;
 			if ( text == ch ) {
@@ -1882,9 +2466,7 @@ SDL_Surface *TTF_RenderUNICODE_Blended(TTF_Font *font,
 			}
 			continue;
 		}
-		if ( swapped ) {
-			c = SDL_Swap16(c);
-		}
+		c = UNICODE_char( ch, swapped, &units );
 		error = Find_Glyph(font, c, CACHED_METRICS|CACHED_PIXMAP);
 		if( error ) {
 			SDL_FreeSurface( textbuf );
@@ -2026,6 +2608,7 @@ void TTF_SetFontStyle( TTF_Font* font, int style )
 	 * */
 	if ( (font->style | TTF_STYLE_NO_GLYPH_CHANGE ) != ( prev_style | TTF_STYLE_NO_GLYPH_CHANGE )) {
 		Flush_Cache( font );
+		Flush_Kept_Sizes( font );
 	}
 }
 
@@ -2038,6 +2621,7 @@ void TTF_SetFontOutline( TTF_Font* font, int outline )
 {
 	font->outline = outline;
 	Flush_Cache( font );
+	Flush_Kept_Sizes( font );
 }
 
 int TTF_GetFontOutline( const TTF_Font* font )
@@ -2057,6 +2641,7 @@ void TTF_SetFontHinting( TTF_Font* font, int hinting )
 		font->hinting = 0;
 
 	Flush_Cache( font );
+	Flush_Kept_Sizes( font );
 }
 
 int TTF_GetFontHinting( const TTF_Font* font )
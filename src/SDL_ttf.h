@@ -88,6 +88,12 @@ extern DECLSPEC TTF_Font * SDLCALL TTF_OpenFontIndex(const char *file, int ptsiz
 extern DECLSPEC TTF_Font * SDLCALL TTF_OpenFontRW(SDL_RWops *src, int freesrc, int ptsize);
 extern DECLSPEC TTF_Font * SDLCALL TTF_OpenFontIndexRW(SDL_RWops *src, int freesrc, int ptsize, long index);
 
+/* Open a font with a FreeType library of its own, instead of the one
+   shared by every other font. FreeType doesn't allow one library to be
+   used by two threads at once, so a font opened this way can render on
+   a different thread from the rest. */
+extern DECLSPEC TTF_Font * SDLCALL TTF_OpenFontPrivate(const char *file, int ptsize);
+
 /* Set and retrieve the font style */
 #define TTF_STYLE_NORMAL	0x00
 #define TTF_STYLE_BOLD		0x01
@@ -107,6 +113,25 @@ extern DECLSPEC void SDLCALL TTF_SetFontOutline(TTF_Font *font, int outline);
 extern DECLSPEC int SDLCALL TTF_GetFontHinting(const TTF_Font *font);
 extern DECLSPEC void SDLCALL TTF_SetFontHinting(TTF_Font *font, int hinting);
 
+/* Set and retrieve the number of rendered glyphs kept for this font.
+   Setting the size empties the cache. */
+#define TTF_DEFAULT_CACHE_SIZE	256
+extern DECLSPEC void SDLCALL TTF_SetFontCacheSize(TTF_Font *font, int size);
+extern DECLSPEC int SDLCALL TTF_GetFontCacheSize(const TTF_Font *font);
+
+/* Get the glyph cache hit, miss and eviction counts for this font.
+   Any of the pointers may be NULL. */
+extern DECLSPEC void SDLCALL TTF_GetFontCacheStats(const TTF_Font *font,
+				     unsigned long *hits, unsigned long *misses,
+				     unsigned long *evictions);
+
+/* Change the point size of an open font, keeping the face loaded.
+   The last TTF_KEPT_SIZES sizes are kept with their glyph caches, so
+   changing back to one of them is cheap.
+   Returns 0 on success, or -1 on error. */
+#define TTF_KEPT_SIZES	3
+extern DECLSPEC int SDLCALL TTF_SetFontSize(TTF_Font *font, int ptsize);
+
 /* Get the total height of the font - usually equal to point size */
 extern DECLSPEC int SDLCALL TTF_FontHeight(const TTF_Font *font);
 
@@ -123,6 +148,12 @@ extern DECLSPEC int SDLCALL TTF_FontDescent(const TTF_Font *font);
 /* Get the recommended spacing between lines of text for this font */
 extern DECLSPEC int SDLCALL TTF_FontLineSkip(const TTF_Font *font);
 
+/* Get the top rows of the underline and strikethrough, from the top of
+   the font, and how many rows thick they are. These are where the render
+   functions draw them, for callers that draw the lines themselves.
+ */
+extern DECLSPEC void SDLCALL TTF_FontLineRows(const TTF_Font *font, int *underline_row, int *strikethrough_row, int *line_height);
+
 /* Get/Set whether or not kerning is allowed for this font */
 extern DECLSPEC int SDLCALL TTF_GetFontKerning(const TTF_Font *font);
 extern DECLSPEC void SDLCALL TTF_SetFontKerning(TTF_Font *font, int allowed);
@@ -132,12 +163,18 @@ extern DECLSPEC long SDLCALL TTF_FontFaces(const TTF_Font *font);
 
 /* Get the font face attributes, if any */
 extern DECLSPEC int SDLCALL TTF_FontFaceIsFixedWidth(const TTF_Font *font);
+extern DECLSPEC int SDLCALL TTF_FontHasColor(const TTF_Font *font);
 extern DECLSPEC char * SDLCALL TTF_FontFaceFamilyName(const TTF_Font *font);
 extern DECLSPEC char * SDLCALL TTF_FontFaceStyleName(const TTF_Font *font);
 
 /* Check wether a glyph is provided by the font or not */
 extern DECLSPEC int SDLCALL TTF_GlyphIsProvided(const TTF_Font *font, Uint16 ch);
 
+/* Call fn with every character in the font's character map, in
+   increasing order */
+typedef void (*TTF_CharFunc)(Uint32 ch, void *data);
+extern DECLSPEC void SDLCALL TTF_FontCharacters(const TTF_Font *font, TTF_CharFunc fn, void *data);
+
 /* Get the metrics (dimensions) of a glyph
    To understand what these metrics mean, here is a useful link:
     http://freetype.sourceforge.net/freetype2/docs/tutorial/step2.html
@@ -186,6 +223,21 @@ extern DECLSPEC SDL_Surface * SDLCALL TTF_RenderUTF8_Shaded(TTF_Font *font,
 extern DECLSPEC SDL_Surface * SDLCALL TTF_RenderUNICODE_Shaded(TTF_Font *font,
 				const Uint16 *text, SDL_Color fg, SDL_Color bg);
 
+/* Draw one character in its own cell, straight into an 8 bit coverage
+   buffer of w x h pixels, where it lands as it would in a surface from
+   TTF_RenderUNICODE_Shaded(). The buffer must be cleared first, and is
+   clipped to, with nothing allocated. Returns 0, or -1 on error. */
+extern DECLSPEC int SDLCALL TTF_RenderGlyph_Cell(TTF_Font *font, Uint32 ch,
+				Uint8 *buffer, int pitch, int w, int h);
+
+/* Draw the colour bitmap of a character (a CBDT or sbix emoji) scaled to
+   fit w x h, in the middle, as premultiplied 0xAARRGGBB pixels, pitch
+   pixels apart. Bitmap only fonts draw from their closest strike. The
+   buffer must be cleared first. Returns 0, or -1 if the font has no
+   colour bitmap for the character. */
+extern DECLSPEC int SDLCALL TTF_RenderGlyph_Color(TTF_Font *font, Uint32 ch,
+				Uint32 *buffer, int pitch, int w, int h);
+
 /* Create an 8-bit palettized surface and render the given glyph at
    high quality with the given font and colors.  The 0 pixel is background,
    while other pixels have varying degrees of the foreground color.
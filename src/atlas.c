@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "terminal.h"
+
+#include "atlas.h"
+#include "blit.h"
+
+struct atlas_slot {
+  struct glyph_key key;
+  int next;        /* next slot in the same hash bucket, -1 for none */
+  char referenced; /* used since the clock hand last passed */
+  Uint32 pinned;   /* pin_stamp while pinned */
+};
+
+static Uint8* masks = NULL;
+static struct atlas_slot* slots = NULL;
+static int* buckets = NULL;
+static int num_slots = 0;
+static int num_buckets = 0;
+static int used_slots = 0;
+static int clock_hand = 0;
+static int slot_w = 0;
+static int slot_h = 0;
+static Uint32 pin_stamp = 0;
+static char pinning = 0;
+
+static unsigned int atlas_hash(const struct glyph_key* key){
+  int i;
+  unsigned int h = 2166136261u;
+  h = (h ^ (unsigned int)key->c) * 16777619u;
+  for(i = 0; i < COMBINING_MAX && key->marks[i] != 0; ++i){
+    h = (h ^ (unsigned int)key->marks[i]) * 16777619u;
+  }
+  h = (h ^ (unsigned int)key->style) * 16777619u;
+  return h % num_buckets;
+}
+
+static int atlas_key_equal(const struct glyph_key* a, const struct glyph_key* b){
+  return a->c == b->c && a->style == b->style &&
+         memcmp(a->marks, b->marks, sizeof(a->marks)) == 0;
+}
+
+/* cell_w and cell_h are the size of one character cell */
+int atlas_init(int cell_w, int cell_h, int num_glyphs){
+  atlas_uninit();
+  slot_w = 2 * cell_w;
+  slot_h = cell_h;
+  num_slots = num_glyphs;
+  num_buckets = 2 * num_glyphs;
+  masks = (Uint8*)malloc((size_t)num_slots * slot_w * slot_h);
+  slots = (struct atlas_slot*)calloc(num_slots, sizeof(struct atlas_slot));
+  buckets = (int*)malloc(num_buckets * sizeof(int));
+  if(masks == NULL || slots == NULL || buckets == NULL){
+    fprintf(stderr, "Couldn't allocate glyph atlas for %d glyphs\n", num_glyphs);
+    atlas_uninit();
+    return TERM_FAILURE;
+  }
+  atlas_flush();
+  PRINT(stderr, "Glyph atlas: %d glyphs of %dx%d\n", num_slots, slot_w, slot_h);
+  return TERM_SUCCESS;
+}
+
+void atlas_uninit(){
+  free(masks);
+  free(slots);
+  free(buckets);
+  masks = NULL;
+  slots = NULL;
+  buckets = NULL;
+  num_slots = 0;
+  num_buckets = 0;
+  used_slots = 0;
+}
+
+/* The contents of the atlas while it is put aside */
+struct atlas_state {
+  Uint8* masks;
+  struct atlas_slot* slots;
+  int* buckets;
+  int num_slots;
+  int num_buckets;
+  int used_slots;
+  int clock_hand;
+  int slot_w;
+  int slot_h;
+};
+
+/* Returns the atlas with its glyphs, leaving the module empty as if
+ * atlas_uninit() had been called. Returns NULL if there is no atlas or
+ * no memory, in which case the atlas is freed. */
+struct atlas_state* atlas_detach(){
+  struct atlas_state* a;
+  if(num_slots == 0){
+    return NULL;
+  }
+  a = (struct atlas_state*)malloc(sizeof(struct atlas_state));
+  if(a == NULL){
+    atlas_uninit();
+    return NULL;
+  }
+  a->masks = masks;
+  a->slots = slots;
+  a->buckets = buckets;
+  a->num_slots = num_slots;
+  a->num_buckets = num_buckets;
+  a->used_slots = used_slots;
+  a->clock_hand = clock_hand;
+  a->slot_w = slot_w;
+  a->slot_h = slot_h;
+  masks = NULL;
+  slots = NULL;
+  buckets = NULL;
+  num_slots = 0;
+  num_buckets = 0;
+  used_slots = 0;
+  return a;
+}
+
+/* Put back an atlas from atlas_detach() in place of the current one */
+void atlas_attach(struct atlas_state* a){
+  atlas_uninit();
+  masks = a->masks;
+  slots = a->slots;
+  buckets = a->buckets;
+  num_slots = a->num_slots;
+  num_buckets = a->num_buckets;
+  used_slots = a->used_slots;
+  clock_hand = a->clock_hand;
+  slot_w = a->slot_w;
+  slot_h = a->slot_h;
+  free(a);
+}
+
+/* Free an atlas from atlas_detach() that won't be put back */
+void atlas_free(struct atlas_state* a){
+  if(a == NULL){
+    return;
+  }
+  free(a->masks);
+  free(a->slots);
+  free(a->buckets);
+  free(a);
+}
+
+/* From here to atlas_pin_end(), the glyphs found or added stay in the
+ * atlas, so masks handed out can be filled in and drawn later, all at
+ * once. atlas_add() returns NULL instead of evicting one of them. */
+void atlas_pin_begin(){
+  if(++pin_stamp == 0){
+    /* stamps from before the wrap could look pinned */
+    for(int s = 0; s < used_slots; ++s){
+      slots[s].pinned = 0;
+    }
+    pin_stamp = 1;
+  }
+  pinning = 1;
+}
+
+void atlas_pin_end(){
+  pinning = 0;
+}
+
+/* forget every glyph */
+void atlas_flush(){
+  int i;
+  for(i = 0; i < num_buckets; ++i){
+    buckets[i] = -1;
+  }
+  used_slots = 0;
+  clock_hand = 0;
+}
+
+/* bytes between rows of a mask */
+int atlas_pitch(){
+  return slot_w;
+}
+
+/* Returns the mask for key, or NULL if it isn't in the atlas */
+Uint8* atlas_find(const struct glyph_key* key){
+  int s;
+  if(num_buckets == 0){
+    return NULL;
+  }
+  for(s = buckets[atlas_hash(key)]; s != -1; s = slots[s].next){
+    if(atlas_key_equal(&slots[s].key, key)){
+      slots[s].referenced = 1;
+      if(pinning){
+        slots[s].pinned = pin_stamp;
+      }
+      return masks + (size_t)s * slot_w * slot_h;
+    }
+  }
+  return NULL;
+}
+
+static void atlas_unlink(int s){
+  int* p = &buckets[atlas_hash(&slots[s].key)];
+  while(*p != -1){
+    if(*p == s){
+      *p = slots[s].next;
+      return;
+    }
+    p = &slots[*p].next;
+  }
+}
+
+/* Returns a cleared mask for key, to be filled in by the caller. When
+ * the atlas is full the clock hand picks a glyph that hasn't been used
+ * lately to make room, passing over pinned ones. Returns NULL if there
+ * is no atlas, or every glyph is pinned. key must not be in the atlas
+ * already. */
+Uint8* atlas_add(const struct glyph_key* key){
+  int s;
+  int steps = 0;
+  unsigned int h;
+  if(num_slots == 0){
+    return NULL;
+  }
+  if(used_slots < num_slots){
+    s = used_slots++;
+  } else {
+    for(;;){
+      /* two turns clear every referenced bit, so all that is left is pinned */
+      if(++steps > 2 * num_slots){
+        return NULL;
+      }
+      s = clock_hand;
+      clock_hand = (clock_hand + 1) % num_slots;
+      if(pinning && slots[s].pinned == pin_stamp){
+        continue;
+      }
+      if(!slots[s].referenced){
+        break;
+      }
+      slots[s].referenced = 0;
+    }
+    atlas_unlink(s);
+  }
+  slots[s].key = *key;
+  slots[s].referenced = 1;
+  slots[s].pinned = pinning ? pin_stamp : 0;
+  h = atlas_hash(key);
+  slots[s].next = buckets[h];
+  buckets[h] = s;
+
+  Uint8* mask = masks + (size_t)s * slot_w * slot_h;
+  memset(mask, 0, (size_t)slot_w * slot_h);
+  return mask;
+}
+
+/* Call fn with every glyph in the atlas, in no particular order */
+void atlas_each(atlas_glyph_fn fn, void* data){
+  int s;
+  for(s = 0; s < used_slots; ++s){
+    fn(&slots[s].key, masks + (size_t)s * slot_w * slot_h, data);
+  }
+}
+
+/* Draw a w x h coverage mask at x,y on dst, shading each pixel
+ * from bg (coverage 0) to fg (coverage 255). */
+void atlas_blit(SDL_Surface* dst, int x, int y, int w, int h,
+                const Uint8* mask, int pitch, SDL_Color fg, SDL_Color bg){
+  int i, j;
+  SDL_PixelFormat* fmt = dst->format;
+
+  /* clip */
+  if(x < 0){ mask -= x; w += x; x = 0; }
+  if(y < 0){ mask -= y * pitch; h += y; y = 0; }
+  if(x + w > dst->w){ w = dst->w - x; }
+  if(y + h > dst->h){ h = dst->h - y; }
+  if(w <= 0 || h <= 0){
+    return;
+  }
+
+  Uint32 fg_pixel = SDL_MapRGB(fmt, fg.r, fg.g, fg.b);
+  Uint32 bg_pixel = SDL_MapRGB(fmt, bg.r, bg.g, bg.b);
+
+  if(SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0){
+    return;
+  }
+  if(fmt->BytesPerPixel == 4 && fmt->Rloss == 0 && fmt->Gloss == 0 && fmt->Bloss == 0 &&
+     fmt->Rshift % 8 == 0 && fmt->Gshift % 8 == 0 && fmt->Bshift % 8 == 0){
+    /* whole byte channels, as on the device: use the vector kernels */
+    blit_mask_32((Uint32*)((Uint8*)dst->pixels + y * dst->pitch) + x, dst->pitch / 4,
+                 mask, pitch, w, h, fg_pixel, bg_pixel);
+    if(SDL_MUSTLOCK(dst)){
+      SDL_UnlockSurface(dst);
+    }
+    return;
+  }
+  for(j = 0; j < h; ++j){
+    const Uint8* m = mask + j * pitch;
+    Uint8* row = (Uint8*)dst->pixels + (y + j) * dst->pitch + x * fmt->BytesPerPixel;
+    for(i = 0; i < w; ++i){
+      Uint32 pixel;
+      int a = m[i];
+      if(a == 0){
+        pixel = bg_pixel;
+      } else if(a == 255){
+        pixel = fg_pixel;
+      } else {
+        Uint8 r = (fg.r * a + bg.r * (255 - a) + 127) / 255;
+        Uint8 g = (fg.g * a + bg.g * (255 - a) + 127) / 255;
+        Uint8 b = (fg.b * a + bg.b * (255 - a) + 127) / 255;
+        pixel = ((r >> fmt->Rloss) << fmt->Rshift) |
+                ((g >> fmt->Gloss) << fmt->Gshift) |
+                ((b >> fmt->Bloss) << fmt->Bshift);
+      }
+      switch(fmt->BytesPerPixel){
+        case 4: ((Uint32*)row)[i] = pixel; break;
+        case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+          row[3 * i] = pixel >> 16; row[3 * i + 1] = pixel >> 8; row[3 * i + 2] = pixel;
+#else
+          row[3 * i] = pixel; row[3 * i + 1] = pixel >> 8; row[3 * i + 2] = pixel >> 16;
+#endif
+          break;
+        case 2: ((Uint16*)row)[i] = (Uint16)pixel; break;
+        default: break;
+      }
+    }
+  }
+  if(SDL_MUSTLOCK(dst)){
+    SDL_UnlockSurface(dst);
+  }
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ATLAS_H_
+#define ATLAS_H_
+
+#include <unicode/utf.h>
+
+#include "SDL.h"
+#include "buffer.h"
+
+/* The glyph atlas holds an 8 bit coverage mask for every glyph drawn
+ * recently, all in one block of memory. Masks carry no colour, so one
+ * mask serves every fg/bg combination, and atlas_blit() colours it in
+ * as it is drawn. Each slot is two cells wide, to fit double width
+ * characters. */
+
+#define ATLAS_DEFAULT_GLYPHS 1024
+
+struct glyph_key {
+  UChar32 c;
+  UChar32 marks[COMBINING_MAX]; /* combining marks, 0 terminated if short */
+  int style;
+};
+
+int atlas_init(int cell_w, int cell_h, int num_glyphs);
+void atlas_uninit();
+void atlas_flush();
+int atlas_pitch();
+
+/* Set the atlas aside and bring it back, glyphs and all, to keep the
+ * glyphs of a font size while another one is in use */
+struct atlas_state;
+struct atlas_state* atlas_detach();
+void atlas_attach(struct atlas_state* a);
+void atlas_free(struct atlas_state* a);
+
+Uint8* atlas_find(const struct glyph_key* key);
+Uint8* atlas_add(const struct glyph_key* key);
+void atlas_pin_begin();
+void atlas_pin_end();
+
+typedef void (*atlas_glyph_fn)(const struct glyph_key* key, const Uint8* mask, void* data);
+void atlas_each(atlas_glyph_fn fn, void* data);
+
+void atlas_blit(SDL_Surface* dst, int x, int y, int w, int h,
+                const Uint8* mask, int pitch, SDL_Color fg, SDL_Color bg);
+
+#endif /* ATLAS_H_ */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "SDL.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "blit.h"
+
+static inline Uint32 blend_pixel(Uint32 fg, Uint32 bg, int a){
+  Uint32 pixel = 0;
+  int shift;
+  if(a == 0){
+    return bg;
+  } else if(a == 255){
+    return fg;
+  }
+  for(shift = 0; shift < 32; shift += 8){
+    Uint32 f = (fg >> shift) & 0xff;
+    Uint32 b = (bg >> shift) & 0xff;
+    pixel |= ((f * a + b * (255 - a) + 127) / 255) << shift;
+  }
+  return pixel;
+}
+
+void blit_mask_32_scalar(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                         int w, int h, Uint32 fg, Uint32 bg){
+  int i, j;
+  for(j = 0; j < h; ++j){
+    const Uint8* m = mask + j * mask_pitch;
+    Uint32* d = dst + j * dst_pitch;
+    for(i = 0; i < w; ++i){
+      d[i] = blend_pixel(fg, bg, m[i]);
+    }
+  }
+}
+
+#ifdef __SSE2__
+/* f, b and a are 8 channels as 16 bit words. (t + 128 + ((t + 128) >> 8)) >> 8
+ * is t / 255 rounded, without a divide. */
+static inline __m128i blend_sse2(__m128i f, __m128i b, __m128i a){
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(f, a),
+                            _mm_mullo_epi16(b, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+  t = _mm_add_epi16(t, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/* 4 pixels at a time */
+void blit_mask_32_sse2(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                       int w, int h, Uint32 fg, Uint32 bg){
+  int i, j;
+  __m128i zero = _mm_setzero_si128();
+  __m128i fg4 = _mm_set1_epi32((int)fg);
+  __m128i bg4 = _mm_set1_epi32((int)bg);
+  __m128i fg16 = _mm_unpacklo_epi8(fg4, zero);
+  __m128i bg16 = _mm_unpacklo_epi8(bg4, zero);
+
+  for(j = 0; j < h; ++j){
+    const Uint8* m = mask + j * mask_pitch;
+    Uint32* d = dst + j * dst_pitch;
+    for(i = 0; i + 4 <= w; i += 4){
+      Uint32 m4;
+      memcpy(&m4, m + i, sizeof(m4));
+      if(m4 == 0){
+        _mm_storeu_si128((__m128i*)(d + i), bg4);
+      } else if(m4 == 0xffffffff){
+        _mm_storeu_si128((__m128i*)(d + i), fg4);
+      } else {
+        /* spread each coverage byte over the 4 bytes of its pixel */
+        __m128i a = _mm_cvtsi32_si128((int)m4);
+        a = _mm_unpacklo_epi8(a, a);
+        a = _mm_unpacklo_epi16(a, a);
+        __m128i lo = blend_sse2(fg16, bg16, _mm_unpacklo_epi8(a, zero));
+        __m128i hi = blend_sse2(fg16, bg16, _mm_unpackhi_epi8(a, zero));
+        _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(lo, hi));
+      }
+    }
+    for(; i < w; ++i){
+      d[i] = blend_pixel(fg, bg, m[i]);
+    }
+  }
+}
+#endif /* __SSE2__ */
+
+#ifdef __ARM_NEON__
+/* same rounding as blend_sse2, with the rounding shifts doing the + 128 */
+static inline uint8x8_t blend_neon(uint8x8_t f, uint8x8_t b, uint8x8_t a, uint8x8_t inv){
+  uint16x8_t t = vmlal_u8(vmull_u8(f, a), b, inv);
+  return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+
+/* 8 pixels at a time, one byte of every pixel per lane */
+void blit_mask_32_neon(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                       int w, int h, Uint32 fg, Uint32 bg){
+  int i, j, k;
+  uint8x8_t f[4], b[4];
+  uint32x4_t fg4 = vdupq_n_u32(fg);
+  uint32x4_t bg4 = vdupq_n_u32(bg);
+
+  for(k = 0; k < 4; ++k){
+    f[k] = vdup_n_u8((fg >> (8 * k)) & 0xff);
+    b[k] = vdup_n_u8((bg >> (8 * k)) & 0xff);
+  }
+  for(j = 0; j < h; ++j){
+    const Uint8* m = mask + j * mask_pitch;
+    Uint32* d = dst + j * dst_pitch;
+    for(i = 0; i + 8 <= w; i += 8){
+      uint8x8_t a = vld1_u8(m + i);
+      uint64_t m8 = vget_lane_u64(vreinterpret_u64_u8(a), 0);
+      if(m8 == 0){
+        vst1q_u32(d + i, bg4);
+        vst1q_u32(d + i + 4, bg4);
+      } else if(m8 == ~(uint64_t)0){
+        vst1q_u32(d + i, fg4);
+        vst1q_u32(d + i + 4, fg4);
+      } else {
+        uint8x8_t inv = vmvn_u8(a);
+        uint8x8x4_t out;
+        out.val[0] = blend_neon(f[0], b[0], a, inv);
+        out.val[1] = blend_neon(f[1], b[1], a, inv);
+        out.val[2] = blend_neon(f[2], b[2], a, inv);
+        out.val[3] = blend_neon(f[3], b[3], a, inv);
+        vst4_u8((uint8_t*)(d + i), out);
+      }
+    }
+    for(; i < w; ++i){
+      d[i] = blend_pixel(fg, bg, m[i]);
+    }
+  }
+}
+#endif /* __ARM_NEON__ */
+
+void blit_mask_32(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                  int w, int h, Uint32 fg, Uint32 bg){
+#if defined(__ARM_NEON__)
+  blit_mask_32_neon(dst, dst_pitch, mask, mask_pitch, w, h, fg, bg);
+#elif defined(__SSE2__)
+  blit_mask_32_sse2(dst, dst_pitch, mask, mask_pitch, w, h, fg, bg);
+#else
+  blit_mask_32_scalar(dst, dst_pitch, mask, mask_pitch, w, h, fg, bg);
+#endif
+}
+
+const struct blit_kernel blit_kernels[] = {
+  { "scalar", blit_mask_32_scalar },
+#ifdef __SSE2__
+  { "sse2", blit_mask_32_sse2 },
+#endif
+#ifdef __ARM_NEON__
+  { "neon", blit_mask_32_neon },
+#endif
+  { NULL, NULL }
+};
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BLIT_H_
+#define BLIT_H_
+
+#include "SDL.h"
+
+/* Kernels that shade an 8 bit coverage mask from bg to fg straight into
+ * 32 bit pixels. fg and bg are already mapped to the display format, and
+ * every channel must be a whole byte (Rloss == 0 and so on), so each byte
+ * of the pixel is blended on its own. All kernels give the same result as
+ * the scalar one: (fg * a + bg * (255 - a) + 127) / 255 per channel.
+ *
+ * dst_pitch and mask_pitch are in pixels and bytes respectively. */
+
+typedef void (*blit_mask_fn)(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                             int w, int h, Uint32 fg, Uint32 bg);
+
+struct blit_kernel {
+  const char* name;
+  blit_mask_fn blit;
+};
+
+void blit_mask_32_scalar(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                         int w, int h, Uint32 fg, Uint32 bg);
+#ifdef __SSE2__
+void blit_mask_32_sse2(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                       int w, int h, Uint32 fg, Uint32 bg);
+#endif
+#ifdef __ARM_NEON__
+void blit_mask_32_neon(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                       int w, int h, Uint32 fg, Uint32 bg);
+#endif
+
+/* the fastest kernel built in */
+void blit_mask_32(Uint32* dst, int dst_pitch, const Uint8* mask, int mask_pitch,
+                  int w, int h, Uint32 fg, Uint32 bg);
+
+/* every kernel built in, scalar first, ending with a NULL name */
+extern const struct blit_kernel blit_kernels[];
+
+#endif /* BLIT_H_ */
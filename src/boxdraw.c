@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "boxdraw.h"
+
+/* line weights */
+enum { N, L, H, D };
+
+/* the weight of the line from the centre to each edge of the cell */
+#define BOX(up, right, down, left) ((up) | (right) << 2 | (down) << 4 | (left) << 6)
+#define BOX_UP(b)    ((b) & 3)
+#define BOX_RIGHT(b) ((b) >> 2 & 3)
+#define BOX_DOWN(b)  ((b) >> 4 & 3)
+#define BOX_LEFT(b)  ((b) >> 6 & 3)
+
+/* U+2500 - U+257F. Dashes, arcs and diagonals are 0 and drawn on their own. */
+static const Uint8 box_lines[0x80] = {
+  BOX(N, L, N, L), BOX(N, H, N, H), BOX(L, N, L, N), BOX(H, N, H, N), /* 2500 */
+  BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), /* 2504 */
+  BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), /* 2508 */
+  BOX(N, L, L, N), BOX(N, H, L, N), BOX(N, L, H, N), BOX(N, H, H, N), /* 250C */
+  BOX(N, N, L, L), BOX(N, N, L, H), BOX(N, N, H, L), BOX(N, N, H, H), /* 2510 */
+  BOX(L, L, N, N), BOX(L, H, N, N), BOX(H, L, N, N), BOX(H, H, N, N), /* 2514 */
+  BOX(L, N, N, L), BOX(L, N, N, H), BOX(H, N, N, L), BOX(H, N, N, H), /* 2518 */
+  BOX(L, L, L, N), BOX(L, H, L, N), BOX(H, L, L, N), BOX(L, L, H, N), /* 251C */
+  BOX(H, L, H, N), BOX(H, H, L, N), BOX(L, H, H, N), BOX(H, H, H, N), /* 2520 */
+  BOX(L, N, L, L), BOX(L, N, L, H), BOX(H, N, L, L), BOX(L, N, H, L), /* 2524 */
+  BOX(H, N, H, L), BOX(H, N, L, H), BOX(L, N, H, H), BOX(H, N, H, H), /* 2528 */
+  BOX(N, L, L, L), BOX(N, L, L, H), BOX(N, H, L, L), BOX(N, H, L, H), /* 252C */
+  BOX(N, L, H, L), BOX(N, L, H, H), BOX(N, H, H, L), BOX(N, H, H, H), /* 2530 */
+  BOX(L, L, N, L), BOX(L, L, N, H), BOX(L, H, N, L), BOX(L, H, N, H), /* 2534 */
+  BOX(H, L, N, L), BOX(H, L, N, H), BOX(H, H, N, L), BOX(H, H, N, H), /* 2538 */
+  BOX(L, L, L, L), BOX(L, L, L, H), BOX(L, H, L, L), BOX(L, H, L, H), /* 253C */
+  BOX(H, L, L, L), BOX(L, L, H, L), BOX(H, L, H, L), BOX(H, L, L, H), /* 2540 */
+  BOX(H, H, L, L), BOX(L, L, H, H), BOX(L, H, H, L), BOX(H, H, L, H), /* 2544 */
+  BOX(L, H, H, H), BOX(H, L, H, H), BOX(H, H, H, L), BOX(H, H, H, H), /* 2548 */
+  BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), /* 254C */
+  BOX(N, D, N, D), BOX(D, N, D, N), BOX(N, D, L, N), BOX(N, L, D, N), /* 2550 */
+  BOX(N, D, D, N), BOX(N, N, L, D), BOX(N, N, D, L), BOX(N, N, D, D), /* 2554 */
+  BOX(L, D, N, N), BOX(D, L, N, N), BOX(D, D, N, N), BOX(L, N, N, D), /* 2558 */
+  BOX(D, N, N, L), BOX(D, N, N, D), BOX(L, D, L, N), BOX(D, L, D, N), /* 255C */
+  BOX(D, D, D, N), BOX(L, N, L, D), BOX(D, N, D, L), BOX(D, N, D, D), /* 2560 */
+  BOX(N, D, L, D), BOX(N, L, D, L), BOX(N, D, D, D), BOX(L, D, N, D), /* 2564 */
+  BOX(D, L, N, L), BOX(D, D, N, D), BOX(L, D, L, D), BOX(D, L, D, L), /* 2568 */
+  BOX(D, D, D, D), BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), /* 256C */
+  BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), BOX(N, N, N, N), /* 2570 */
+  BOX(N, N, N, L), BOX(L, N, N, N), BOX(N, L, N, N), BOX(N, N, L, N), /* 2574 */
+  BOX(N, N, N, H), BOX(H, N, N, N), BOX(N, H, N, N), BOX(N, N, H, N), /* 2578 */
+  BOX(N, H, N, L), BOX(L, N, H, N), BOX(N, L, N, H), BOX(H, N, L, N), /* 257C */
+};
+
+struct box_cell {
+  Uint8* mask;
+  int pitch;
+  int w;
+  int h;
+  int light; /* line thickness */
+  int heavy;
+  int gap;   /* distance from the centre to each line of a double line */
+};
+
+static int imax(int a, int b){
+  return a > b ? a : b;
+}
+
+static void fill(struct box_cell* b, int x0, int y0, int x1, int y1, Uint8 value){
+  int y;
+  if(x0 < 0){ x0 = 0; }
+  if(y0 < 0){ y0 = 0; }
+  if(x1 > b->w){ x1 = b->w; }
+  if(y1 > b->h){ y1 = b->h; }
+  for(y = y0; y < y1 && x0 < x1; ++y){
+    memset(b->mask + y * b->pitch + x0, value, x1 - x0);
+  }
+}
+
+static int thickness(struct box_cell* b, int weight){
+  switch(weight){
+    case L: return b->light;
+    case H: return b->heavy;
+    case D: return b->light;
+    default: return 0;
+  }
+}
+
+/* The edge of a line t thick centred on c: the far edge
+ * when going forward (dir > 0), else the near one. */
+static int band_edge(int c, int t, int dir){
+  int lo = c - t / 2;
+  return dir > 0 ? lo + t : lo;
+}
+
+/* A line t thick centred on across, from the edge of the cell to end.
+ * dir > 0 runs from the top or left edge, dir < 0 from the other. */
+static void stroke(struct box_cell* b, int vertical, int across, int t, int end, int dir){
+  int lo = across - t / 2;
+  int size = vertical ? b->h : b->w;
+  int from = dir > 0 ? 0 : end;
+  int to = dir > 0 ? end : size;
+  if(vertical){
+    fill(b, lo, from, lo + t, to, 255);
+  } else {
+    fill(b, from, lo, to, lo + t, 255);
+  }
+}
+
+/* Draw one arm of a box character, from the edge of the cell to where it
+ * meets the others at (across, along). perp_neg and perp_pos are the arms
+ * at right angles, on the side of the first and second line of a double
+ * line. Double lines are joined the way they are drawn by hand: each line
+ * stops at the nearest line it meets, or carries on to the far one to
+ * turn a corner. */
+static void draw_arm(struct box_cell* b, int vertical, int weight, int opposite,
+                     int perp_neg, int perp_pos, int across, int along, int dir){
+  int perp_double = perp_neg == D || perp_pos == D;
+  int perp_t = imax(thickness(b, perp_neg), thickness(b, perp_pos));
+  int end, side;
+
+  if(weight == N){
+    return;
+  }
+  if(weight != D){
+    int t = thickness(b, weight);
+    if(opposite != N || perp_t == 0){
+      end = band_edge(along, t, dir);
+    } else if(perp_double){
+      /* stop at the near line of a straight double line, else cross it */
+      int near = perp_neg != N && perp_pos != N;
+      end = band_edge(along + (near ? -dir : dir) * b->gap, b->light, dir);
+    } else {
+      end = band_edge(along, perp_t, dir);
+    }
+    stroke(b, vertical, across, t, end, dir);
+    return;
+  }
+  for(side = -1; side <= 1; side += 2){
+    int present = side < 0 ? perp_neg : perp_pos;
+    if(perp_t == 0){
+      end = band_edge(along, b->light, dir);
+    } else if(!perp_double){
+      end = band_edge(along, perp_t, dir);
+    } else if(present != N){
+      end = band_edge(along - dir * b->gap, b->light, dir);
+    } else if(opposite != N){
+      end = band_edge(along, b->light, dir);
+    } else {
+      end = band_edge(along + dir * b->gap, b->light, dir);
+    }
+    stroke(b, vertical, across + side * b->gap, b->light, end, dir);
+  }
+}
+
+static void draw_lines(struct box_cell* b, Uint8 lines){
+  int cx = b->w / 2;
+  int cy = b->h / 2;
+  draw_arm(b, 1, BOX_UP(lines), BOX_DOWN(lines), BOX_LEFT(lines), BOX_RIGHT(lines), cx, cy, 1);
+  draw_arm(b, 1, BOX_DOWN(lines), BOX_UP(lines), BOX_LEFT(lines), BOX_RIGHT(lines), cx, cy, -1);
+  draw_arm(b, 0, BOX_LEFT(lines), BOX_RIGHT(lines), BOX_UP(lines), BOX_DOWN(lines), cy, cx, 1);
+  draw_arm(b, 0, BOX_RIGHT(lines), BOX_LEFT(lines), BOX_UP(lines), BOX_DOWN(lines), cy, cx, -1);
+}
+
+/* n dashes, spaced so they line up with the dashes in the next cell */
+static void draw_dashes(struct box_cell* b, int vertical, int weight, int n){
+  int i;
+  int t = thickness(b, weight);
+  int size = vertical ? b->h : b->w;
+  int lo = (vertical ? b->w : b->h) / 2 - t / 2;
+  for(i = 0; i < n; ++i){
+    int start = i * size / n;
+    int end = (i + 1) * size / n;
+    int gap = imax(1, (end - start) / 4);
+    start += gap / 2;
+    end -= gap - gap / 2;
+    if(vertical){
+      fill(b, lo, start, lo + t, end, 255);
+    } else {
+      fill(b, start, lo, end, lo + t, 255);
+    }
+  }
+}
+
+/* Shade each pixel by how many of its 4x4 sample points are within
+ * half a light line of the curve: an arc when radius > 0, else the
+ * line through (x0, y0) with direction (dx, dy). */
+static void draw_curve(struct box_cell* b, double x0, double y0, double dx, double dy,
+                       double radius, int sx, int sy){
+  int x, y, i, j;
+  double half = b->light / 2.0;
+  double len = sqrt(dx * dx + dy * dy);
+  for(y = 0; y < b->h; ++y){
+    for(x = 0; x < b->w; ++x){
+      int hits = 0;
+      for(j = 0; j < 4; ++j){
+        for(i = 0; i < 4; ++i){
+          double px = x + (i + 0.5) / 4;
+          double py = y + (j + 0.5) / 4;
+          double dist;
+          if(radius > 0){
+            /* only the quarter of the circle facing the corner */
+            if((px - x0) * sx > 0 || (py - y0) * sy > 0){
+              continue;
+            }
+            dist = fabs(hypot(px - x0, py - y0) - radius);
+          } else {
+            dist = fabs((px - x0) * dy - (py - y0) * dx) / len;
+          }
+          if(dist <= half){
+            ++hits;
+          }
+        }
+      }
+      if(hits > 0){
+        Uint8* p = b->mask + y * b->pitch + x;
+        int v = *p + hits * 255 / 16;
+        *p = v > 255 ? 255 : v;
+      }
+    }
+  }
+}
+
+/* A rounded corner joining the lines out to the sx and sy sides */
+static void draw_arc(struct box_cell* b, int sx, int sy){
+  int lo_x = b->w / 2 - b->light / 2;
+  int lo_y = b->h / 2 - b->light / 2;
+  double fx = lo_x + b->light / 2.0;
+  double fy = lo_y + b->light / 2.0;
+  double rx = sx > 0 ? b->w - fx : fx;
+  double ry = sy > 0 ? b->h - fy : fy;
+  double r = rx < ry ? rx : ry;
+  double ccx = fx + sx * r;
+  double ccy = fy + sy * r;
+
+  draw_curve(b, ccx, ccy, 0, 0, r, sx, sy);
+  if(sy > 0){
+    fill(b, lo_x, (int)ccy, lo_x + b->light, b->h, 255);
+  } else {
+    fill(b, lo_x, 0, lo_x + b->light, (int)ceil(ccy), 255);
+  }
+  if(sx > 0){
+    fill(b, (int)ccx, lo_y, b->w, lo_y + b->light, 255);
+  } else {
+    fill(b, 0, lo_y, (int)ceil(ccx), lo_y + b->light, 255);
+  }
+}
+
+static void draw_box(struct box_cell* b, UChar32 c){
+  Uint8 lines = box_lines[c - 0x2500];
+  if(lines != 0){
+    draw_lines(b, lines);
+    return;
+  }
+  switch(c){
+    case 0x2504: draw_dashes(b, 0, L, 3); break;
+    case 0x2505: draw_dashes(b, 0, H, 3); break;
+    case 0x2506: draw_dashes(b, 1, L, 3); break;
+    case 0x2507: draw_dashes(b, 1, H, 3); break;
+    case 0x2508: draw_dashes(b, 0, L, 4); break;
+    case 0x2509: draw_dashes(b, 0, H, 4); break;
+    case 0x250A: draw_dashes(b, 1, L, 4); break;
+    case 0x250B: draw_dashes(b, 1, H, 4); break;
+    case 0x254C: draw_dashes(b, 0, L, 2); break;
+    case 0x254D: draw_dashes(b, 0, H, 2); break;
+    case 0x254E: draw_dashes(b, 1, L, 2); break;
+    case 0x254F: draw_dashes(b, 1, H, 2); break;
+    case 0x256D: draw_arc(b, 1, 1); break;
+    case 0x256E: draw_arc(b, -1, 1); break;
+    case 0x256F: draw_arc(b, -1, -1); break;
+    case 0x2570: draw_arc(b, 1, -1); break;
+    case 0x2571: draw_curve(b, 0, b->h, b->w, -b->h, 0, 0, 0); break;
+    case 0x2572: draw_curve(b, 0, 0, b->w, b->h, 0, 0, 0); break;
+    case 0x2573:
+      draw_curve(b, 0, b->h, b->w, -b->h, 0, 0, 0);
+      draw_curve(b, 0, 0, b->w, b->h, 0, 0, 0);
+      break;
+    default: break;
+  }
+}
+
+/* U+2580 - U+259F */
+static void draw_block(struct box_cell* b, UChar32 c){
+  /* eighths of the cell, rounded so neighbouring blocks meet */
+#define EIGHTH_X(k) ((b->w * (k) + 4) / 8)
+#define EIGHTH_Y(k) ((b->h * (k) + 4) / 8)
+  /* quadrants: upper left, upper right, lower left, lower right */
+  static const Uint8 quadrants[10] = { 4, 8, 1, 1|4|8, 1|8, 1|2|4, 1|2|8, 2, 2|4, 2|4|8 };
+  int w = b->w;
+  int h = b->h;
+
+  if(c == 0x2580){
+    fill(b, 0, 0, w, EIGHTH_Y(4), 255);
+  } else if(c <= 0x2588){
+    fill(b, 0, EIGHTH_Y(0x2588 - c), w, h, 255);
+  } else if(c <= 0x258F){
+    fill(b, 0, 0, EIGHTH_X(0x2590 - c), h, 255);
+  } else if(c == 0x2590){
+    fill(b, EIGHTH_X(4), 0, w, h, 255);
+  } else if(c <= 0x2593){
+    /* shades */
+    fill(b, 0, 0, w, h, (Uint8)(64 * (c - 0x2590)));
+  } else if(c == 0x2594){
+    fill(b, 0, 0, w, EIGHTH_Y(1), 255);
+  } else if(c == 0x2595){
+    fill(b, EIGHTH_X(7), 0, w, h, 255);
+  } else {
+    int q = quadrants[c - 0x2596];
+    int mx = EIGHTH_X(4);
+    int my = EIGHTH_Y(4);
+    if(q & 1){ fill(b, 0, 0, mx, my, 255); }
+    if(q & 2){ fill(b, mx, 0, w, my, 255); }
+    if(q & 4){ fill(b, 0, my, mx, h, 255); }
+    if(q & 8){ fill(b, mx, my, w, h, 255); }
+  }
+#undef EIGHTH_X
+#undef EIGHTH_Y
+}
+
+/* U+2800 - U+28FF: 8 dots in 2 columns of 4, one bit each */
+static void draw_braille(struct box_cell* b, UChar32 c){
+  static const Uint8 dot_col[8] = { 0, 0, 0, 1, 1, 1, 0, 1 };
+  static const Uint8 dot_row[8] = { 0, 1, 2, 0, 1, 2, 3, 3 };
+  int bits = c - 0x2800;
+  int size = imax(1, b->w / 4 < b->h / 8 ? b->w / 4 : b->h / 8);
+  int i;
+  for(i = 0; i < 8; ++i){
+    if(bits & (1 << i)){
+      int x = b->w * (2 * dot_col[i] + 1) / 4 - size / 2;
+      int y = b->h * (2 * dot_row[i] + 1) / 8 - size / 2;
+      fill(b, x, y, x + size, y + size, 255);
+    }
+  }
+}
+
+/* Returns 1 if c is drawn by boxdraw_render() */
+int boxdraw_has(UChar32 c){
+  return (c >= BOXDRAW_FIRST && c <= BOXDRAW_LAST) || (c >= 0x2800 && c <= 0x28FF);
+}
+
+/* Draw c into a cleared w x h coverage mask. Lines are as thick as the
+ * strokes of a typical font at this cell width. */
+void boxdraw_render(UChar32 c, Uint8* mask, int pitch, int w, int h){
+  struct box_cell b;
+  b.mask = mask;
+  b.pitch = pitch;
+  b.w = w;
+  b.h = h;
+  b.light = imax(1, w / 8);
+  b.heavy = 2 * b.light;
+  b.gap = b.light;
+
+  if(c >= 0x2500 && c <= 0x257F){
+    draw_box(&b, c);
+  } else if(c >= 0x2580 && c <= 0x259F){
+    draw_block(&b, c);
+  } else if(c >= 0x2800 && c <= 0x28FF){
+    draw_braille(&b, c);
+  }
+}
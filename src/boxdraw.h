@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BOXDRAW_H_
+#define BOXDRAW_H_
+
+#include <unicode/utf.h>
+
+#include "SDL.h"
+
+/* Box drawing (U+2500 - U+257F), block elements (U+2580 - U+259F) and
+ * braille (U+2800 - U+28FF) are drawn here instead of by the font, as
+ * coverage masks exactly one cell in size. Fonts rarely fill the whole
+ * line height, which leaves gaps between rows of borders and bars. */
+
+#define BOXDRAW_FIRST 0x2500
+#define BOXDRAW_LAST  0x259F
+
+int boxdraw_has(UChar32 c);
+void boxdraw_render(UChar32 c, Uint8* mask, int pitch, int w, int h);
+
+#endif /* BOXDRAW_H_ */
@@ -36,8 +36,26 @@ int MAX_COLS;
 int MAX_ROWS;
 int TEXT_BUFFER_SIZE;
 
-/* from main.c */
-extern SDL_Surface* blank_surface;
+/* set when the whole screen has to be redrawn, cleared by render() */
+char full_damage = 1;
+/* scrolling since the last render, cleared by render() */
+struct scroll_damage scroll_damage;
+
+/* Combining marks don't get a cell of their own, they are attached to
+ * the character before them. Very few cells ever have any, so instead of
+ * making every screenchar bigger they are kept in this overflow arena and
+ * the cell just holds an index into it. Free slots are chained through
+ * marks[0], using the same index + 1 encoding as screenchar.combining. */
+struct combining_marks {
+  UChar32 marks[COMBINING_MAX];
+};
+#define COMBINING_ARENA_INITIAL 256
+#define COMBINING_ARENA_MAX 65535
+static struct combining_marks* combining_arena = NULL;
+static int combining_size = 0;
+static int combining_free = 0;
+
+/* from render.c */
 extern struct font_style default_text_style;
 
 /* assumes that MAX_COLS, MAX_ROWS, TEXT_BUFFER_SIZE are set already */
@@ -57,9 +75,10 @@ int buf_init(){
     buf->text = (struct screenchar**)calloc(TEXT_BUFFER_SIZE + 1, sizeof(struct screenchar*));
     if(buf->text == NULL){ return TERM_FAILURE;}
     for(i=0; i< TEXT_BUFFER_SIZE + 1;++i){
-      buf->text[i] = (struct screenchar*)calloc(MAX_COLS+1, sizeof(struct screenchar));
-      if(buf->text[i] == NULL){ return TERM_FAILURE;}
-      buf_erase_line(buf->text[i], (size_t)MAX_COLS);
+      union line_header* header = (union line_header*)calloc(1, sizeof(union line_header) + (MAX_COLS+1) * sizeof(struct screenchar));
+      if(header == NULL){ return TERM_FAILURE;}
+      buf->text[i] = (struct screenchar*)(header + 1);
+      buf_clear_line(buf->text[i], (size_t)MAX_COLS);
     }
   }
   buf = &screens[0];
@@ -108,7 +127,7 @@ void buf_uninit(){
     for(i=0; i< TEXT_BUFFER_SIZE + 1;++i){
       if(buf->text[i] != NULL){
         buf_erase_line(buf->text[i], (size_t)MAX_COLS);
-        free(buf->text[i]);
+        free(((union line_header*)buf->text[i]) - 1);
       }
     }
     free(buf->text);
@@ -117,6 +136,10 @@ void buf_uninit(){
     free(tabs[i]);
   }
   free(tabs);
+  free(combining_arena);
+  combining_arena = NULL;
+  combining_size = 0;
+  combining_free = 0;
 }
 
 /* returns the bottom buffer line showing on the screen */
@@ -176,26 +199,156 @@ int screen_to_buf_row(int y_screen){
 }
 
 
+static int buf_grow_combining(){
+  int i;
+  int new_size = combining_size ? combining_size * 2 : COMBINING_ARENA_INITIAL;
+  if(new_size > COMBINING_ARENA_MAX){
+    new_size = COMBINING_ARENA_MAX;
+  }
+  if(new_size <= combining_size){
+    return TERM_FAILURE;
+  }
+  struct combining_marks* arena = (struct combining_marks*)realloc(combining_arena, new_size * sizeof(struct combining_marks));
+  if(arena == NULL){
+    return TERM_FAILURE;
+  }
+  /* chain the new slots onto the free list */
+  for(i = combining_size; i < new_size; ++i){
+    arena[i].marks[0] = i + 1 < new_size ? i + 2 : combining_free;
+  }
+  combining_free = combining_size + 1;
+  combining_arena = arena;
+  combining_size = new_size;
+  return TERM_SUCCESS;
+}
+
+static void buf_release_combining(struct screenchar* sc){
+  if(sc->combining){
+    combining_arena[sc->combining - 1].marks[0] = combining_free;
+    combining_free = sc->combining;
+    sc->combining = 0;
+  }
+}
+
+/* Attach a combining mark to sc. Marks past COMBINING_MAX,
+ * or past the size of the arena, are dropped. */
+void buf_add_combining(struct screenchar* sc, UChar32 mark){
+  struct combining_marks* cm;
+  int i;
+  if(sc->combining == 0){
+    if(combining_free == 0 && buf_grow_combining() == TERM_FAILURE){
+      PRINT(stderr, "Combining mark arena full - dropping mark %x\n", mark);
+      return;
+    }
+    sc->combining = combining_free;
+    cm = &combining_arena[sc->combining - 1];
+    combining_free = cm->marks[0];
+    bzero(cm, sizeof(struct combining_marks));
+  }
+  cm = &combining_arena[sc->combining - 1];
+  for(i = 0; i < COMBINING_MAX; ++i){
+    if(cm->marks[i] == 0){
+      cm->marks[i] = mark;
+      break;
+    }
+  }
+}
+
+/* Copies the combining marks of sc into marks, which must have
+ * room for COMBINING_MAX entries. Returns the number of marks. */
+int buf_get_combining(struct screenchar* sc, UChar32* marks){
+  int n = 0;
+  if(sc->combining){
+    struct combining_marks* cm = &combining_arena[sc->combining - 1];
+    while(n < COMBINING_MAX && cm->marks[n] != 0){
+      marks[n] = cm->marks[n];
+      ++n;
+    }
+  }
+  return n;
+}
+
 void buf_free_char(struct screenchar* sc){
-  if((sc->surface != NULL) && (sc->surface != blank_surface)){
-    SDL_FreeSurface(sc->surface);
+  buf_release_combining(sc);
+}
+
+/* Record that n cells of line starting at col need to be drawn again */
+void buf_mark_dirty(struct screenchar* line, int col, int n){
+  struct line_info* li = buf_line_info(line);
+  if(li->dirty_end <= li->dirty_start){
+    li->dirty_start = col;
+    li->dirty_end = col + n;
+  } else {
+    li->dirty_start = col < li->dirty_start ? col : li->dirty_start;
+    li->dirty_end = col + n > li->dirty_end ? col + n : li->dirty_end;
   }
-  sc->surface = NULL;
 }
 
-void buf_erase_line(struct screenchar* sc, size_t n){
+void buf_mark_line_dirty(struct screenchar* line){
+  buf_mark_dirty(line, 0, MAX_COLS);
+}
+
+/* Record that the lines on screen rows [top, bottom) moved up n rows
+ * (down if n is negative). Rows are counted from 0. */
+void buf_note_scroll(int top, int bottom, int n){
+  struct scroll_damage* sd = &scroll_damage;
+  if(sd->mixed || n == 0){
+    return;
+  }
+  if(sd->amount == 0){
+    sd->top = top;
+    sd->bottom = bottom;
+    sd->amount = n;
+  } else if(sd->top == top && sd->bottom == bottom){
+    sd->amount += n;
+  } else {
+    sd->mixed = 1;
+  }
+}
+
+/* erase n cells of line, starting at col */
+void buf_erase_span(struct screenchar* line, int col, size_t n){
   size_t i;
+  struct screenchar* sc = &line[col];
   for(i = 0; i < n; ++i){
     buf_free_char(&sc[i]);
     sc[i].c = ' ';
     sc[i].style = buf->current_style;
+    sc[i].wide = 0;
   }
+  buf_mark_dirty(line, col, (int)n);
+}
+
+/* erase the first n cells of a line */
+void buf_erase_line(struct screenchar* sc, size_t n){
+  buf_erase_span(sc, 0, n);
+}
+
+/* Call before overwriting line[col]. Overwriting either half of a double
+ * width character destroys the whole character, so blank the other half.
+ * Columns outside the visible line are left alone. */
+void buf_split_wide_char(struct screenchar* line, int col){
+  if(col < 0 || col >= cols){
+    return;
+  }
+  if(line[col].wide == SC_WIDE_RIGHT && col > 0){
+    buf_erase_span(line, col-1, 1);
+  } else if(line[col].wide == SC_WIDE_LEFT && col < cols - 1){
+    buf_erase_span(line, col+1, 1);
+  }
+}
+
+/* Erase the first n cells of a line, and reset the attributes
+ * of the line itself. Use this when the whole line goes away. */
+void buf_clear_line(struct screenchar* line, size_t n){
+  buf_erase_line(line, n);
+  buf_line_info(line)->size = LINE_SINGLE_WIDTH;
 }
 
 void buf_erase_lines(int start_line, int num){
 	int i;
 	for(i = 0; i < num; ++i){
-		buf_erase_line(buf->text[start_line + i], cols);
+		buf_clear_line(buf->text[start_line + i], cols);
 	}
 }
 
@@ -284,7 +437,7 @@ void buf_check_screen_scroll(){
       tmp = buf->text[i];
       buf->text[i] = buf->text[i+shift];
       buf->text[i+shift] = tmp;
-      buf_erase_line(buf->text[i+shift], MAX_COLS);
+      buf_clear_line(buf->text[i+shift], MAX_COLS);
     }
     // and update the pointers
     buf->top_line -= shift;
@@ -295,9 +448,10 @@ void buf_check_screen_scroll(){
   if(buf->line - buf->top_line >= rows){
     // if the buffer last line is now behind the writing line
     // increment the buffer top line
+    buf_note_scroll(0, rows, buf->line - (rows - 1) - buf->top_line);
     buf->top_line = buf->line - (rows - 1);
     // and erase the newly revealed line
-    buf_erase_line(buf->text[buf->line], cols);
+    buf_clear_line(buf->text[buf->line], cols);
   }
 
   PRINT(stderr, "top line = %d, text_line = %d\n", buf->top_line, buf->line);
@@ -315,7 +469,7 @@ void buf_check_screen_rscroll(){
       tmp = buf->text[i + shift];
       buf->text[i+shift] = buf->text[i];
       buf->text[i] = tmp;
-      buf_erase_line(buf->text[i], cols);
+      buf_clear_line(buf->text[i], cols);
     }
     // and update the pointers
     buf->top_line += shift;
@@ -326,9 +480,10 @@ void buf_check_screen_rscroll(){
   if(buf->line < buf->top_line){
     // if the buffer writing line is now above the top line
     // move the top line to the writing line
+    buf_note_scroll(0, rows, buf->line - buf->top_line);
     buf->top_line = buf->line;
     // and erase the newly revealed line
-    buf_erase_line(buf->text[buf->line], cols);
+    buf_clear_line(buf->text[buf->line], cols);
   }
 
   PRINT(stderr, "top line = %d, text_line = %d\n", buf->top_line, buf->line);
@@ -357,7 +512,8 @@ void buf_scroll_scroll_region(){
     buf->text[buf->top_line + j - 1] = buf->text[buf->top_line + j];
   }
   buf->text[buf->top_line + sr.bottom - 1] = tmp;
-  buf_erase_line(buf->text[buf->top_line + sr.bottom - 1], cols);
+  buf_clear_line(buf->text[buf->top_line + sr.bottom - 1], cols);
+  buf_note_scroll(sr.top - 1, sr.bottom, 1);
 }
 
 void buf_rscroll_scroll_region(){
@@ -367,7 +523,8 @@ void buf_rscroll_scroll_region(){
     buf->text[buf->top_line + j] = buf->text[buf->top_line + j -1];
   }
   buf->text[buf->top_line + sr.top - 1] = tmp;
-  buf_erase_line(buf->text[buf->top_line + sr.top - 1], cols);
+  buf_clear_line(buf->text[buf->top_line + sr.top - 1], cols);
+  buf_note_scroll(sr.top - 1, sr.bottom, -1);
 }
 
 void buf_increment_line(){
@@ -429,7 +586,7 @@ void buf_decrement_line(){
 void buf_delete_character(char shift_preceding){
 
   /* start by blanking out the char under the cursor */
-  buf_erase_line(&buf->text[buf->line][buf->col], 1);
+  buf_erase_span(buf->text[buf->line], buf->col, 1);
   /* then shift */
   struct screenchar sc = buf->text[buf->line][buf->col];
   int i;
@@ -438,11 +595,13 @@ void buf_delete_character(char shift_preceding){
       buf->text[buf->line][i] = buf->text[buf->line][i-1];
     }
     buf->text[buf->line][0] = sc;
+    buf_mark_dirty(buf->text[buf->line], 0, buf->col + 1);
   } else {
     for(i = buf->col; i < cols - 1; ++i){
       buf->text[buf->line][i] = buf->text[buf->line][i+1];
     }
     buf->text[buf->line][cols-1] = sc;
+    buf_mark_dirty(buf->text[buf->line], buf->col, cols - buf->col);
   }
 }
 
@@ -479,15 +638,17 @@ void buf_insert_character(char shift_preceding){
       buf->text[buf->line][i] = buf->text[buf->line][i+1];
     }
     buf->text[buf->line][buf->col] = sc;
+    buf_mark_dirty(buf->text[buf->line], 0, buf->col + 1);
   } else {
     sc = buf->text[buf->line][cols-1];
     for(i = cols-1; i > buf->col; --i){
       buf->text[buf->line][i] = buf->text[buf->line][i-1];
     }
     buf->text[buf->line][buf->col] = sc;
+    buf_mark_dirty(buf->text[buf->line], buf->col, cols - buf->col);
   }
   /* end by blanking out the char under the cursor */
-  buf_erase_line(&buf->text[buf->line][buf->col], 1);
+  buf_erase_span(buf->text[buf->line], buf->col, 1);
 }
 
 void buf_insert_character_following(int n){
@@ -508,14 +669,10 @@ void buf_insert_character_preceding(int n){
   }
 }
 
+/* Cells don't hold rendered glyphs any more, so
+ * this only has to get the whole screen drawn again */
 void buf_clear_all_renders(){
-  int i = 0;
-  int j = 0;
-  for(i=0; i<TEXT_BUFFER_SIZE; ++i){
-    for(j=0; j<MAX_COLS;++j){
-      buf_free_char(&(buf->text[i][j]));
-    }
-  }
+  full_damage = 1;
 }
 
 void buf_reset_text_buffer(buf_t* toclear){
@@ -526,7 +683,10 @@ void buf_reset_text_buffer(buf_t* toclear){
       buf_free_char(&(toclear->text[i][j]));
       (toclear->text[i][j]).c = 0;
       (toclear->text[i][j]).style = default_text_style;
+      (toclear->text[i][j]).wide = 0;
     }
+    buf_line_info(toclear->text[i])->size = LINE_SINGLE_WIDTH;
+    buf_mark_line_dirty(toclear->text[i]);
   }
   toclear->top_line = 0;
   toclear->line = 0;
@@ -26,14 +26,47 @@ struct font_style {
   SDL_Color bg_color;
   int style;
   char reverse;
+  char blink;
 };
 
+/* values of screenchar.wide */
+#define SC_WIDE_LEFT 1  /* first cell of a double width character */
+#define SC_WIDE_RIGHT 2 /* continuation cell, holds no character of its own */
+
+/* the most combining marks we keep for a single cell */
+#define COMBINING_MAX 4
+
 struct screenchar {
-  UChar c;
+  UChar32 c;
   struct font_style style;
-  SDL_Surface* surface;
+  char wide;
+  /* index + 1 of the combining marks in the overflow arena, 0 for none */
+  unsigned short combining;
+};
+
+/* Line size attributes (DECDHL, DECSWL, DECDWL) */
+#define LINE_SINGLE_WIDTH 0
+#define LINE_DOUBLE_WIDTH 1
+#define LINE_DOUBLE_TOP 2     /* double height, top half */
+#define LINE_DOUBLE_BOTTOM 3  /* double height, bottom half */
+
+/* Attributes of a whole line. These live in memory just in front of the
+ * line's cells, so they stay with the line when lines are scrolled by
+ * swapping pointers. Use buf_line_info(buf->text[n]) to get at them. */
+struct line_info {
+  char size;
+  /* columns changed since the line was last drawn, as [start, end) */
+  int dirty_start;
+  int dirty_end;
+};
+
+union line_header {
+  struct line_info info;
+  struct screenchar align; /* keeps the cells after the header aligned */
 };
 
+#define buf_line_info(line) (&((((union line_header*)(line)) - 1)->info))
+
 struct text {
   struct screenchar** text;
   int line;
@@ -59,6 +92,16 @@ struct scroll_region {
   int bottom;
 };
 
+/* The net scrolling since the last render(), so the renderer can move
+ * pixels instead of drawing the scrolled rows again. The lines on screen
+ * rows [top, bottom) moved up by amount rows, or down if it is negative. */
+struct scroll_damage {
+  int top;
+  int bottom;
+  int amount;
+  char mixed; /* more than one region scrolled, nothing to reuse */
+};
+
 #define TAB_WIDTH 8
 #define TAB_HEIGHT 2
 
@@ -66,8 +109,16 @@ int buf_init();
 void buf_uninit();
 int buf_bottom_line();
 void buf_erase_line(struct screenchar* sc, size_t n);
+void buf_erase_span(struct screenchar* line, int col, size_t n);
+void buf_mark_dirty(struct screenchar* line, int col, int n);
+void buf_mark_line_dirty(struct screenchar* line);
+void buf_note_scroll(int top, int bottom, int n);
 void buf_erase_lines(int start_line, int num);
+void buf_clear_line(struct screenchar* line, size_t n);
 void buf_free_char(struct screenchar* sc);
+void buf_add_combining(struct screenchar* sc, UChar32 mark);
+int buf_get_combining(struct screenchar* sc, UChar32* marks);
+void buf_split_wide_char(struct screenchar* line, int col);
 void buf_check_screen_scroll();
 void buf_check_screen_rscroll();
 void buf_increment_line();
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "terminal.h"
+
+#include "charset.h"
+
+#define CHARSET_MAX 0x10ffff
+#define CHARSET_PAGE_SHIFT 8
+#define CHARSET_PAGE_BYTES ((1 << CHARSET_PAGE_SHIFT) / 8)
+#define CHARSET_NUM_PAGES ((CHARSET_MAX + 1) >> CHARSET_PAGE_SHIFT)
+
+struct charset {
+  Uint16 page_index[CHARSET_NUM_PAGES]; /* index + 1 into pages, 0 for an empty page */
+  Uint8* pages;
+  int num_pages;
+};
+
+struct charset* charset_new(){
+  return (struct charset*)calloc(1, sizeof(struct charset));
+}
+
+void charset_free(struct charset* set){
+  if(set != NULL){
+    free(set->pages);
+    free(set);
+  }
+}
+
+int charset_add(struct charset* set, UChar32 c){
+  int p;
+  if(c < 0 || c > CHARSET_MAX){
+    return TERM_FAILURE;
+  }
+  p = set->page_index[c >> CHARSET_PAGE_SHIFT];
+  if(p == 0){
+    Uint8* pages = (Uint8*)realloc(set->pages, (size_t)(set->num_pages + 1) * CHARSET_PAGE_BYTES);
+    if(pages == NULL){
+      return TERM_FAILURE;
+    }
+    set->pages = pages;
+    memset(pages + (size_t)set->num_pages * CHARSET_PAGE_BYTES, 0, CHARSET_PAGE_BYTES);
+    p = ++set->num_pages;
+    set->page_index[c >> CHARSET_PAGE_SHIFT] = (Uint16)p;
+  }
+  c &= (1 << CHARSET_PAGE_SHIFT) - 1;
+  set->pages[(p - 1) * CHARSET_PAGE_BYTES + (c >> 3)] |= 1 << (c & 7);
+  return TERM_SUCCESS;
+}
+
+int charset_has(const struct charset* set, UChar32 c){
+  int p;
+  if(c < 0 || c > CHARSET_MAX){
+    return 0;
+  }
+  p = set->page_index[c >> CHARSET_PAGE_SHIFT];
+  if(p == 0){
+    return 0;
+  }
+  c &= (1 << CHARSET_PAGE_SHIFT) - 1;
+  return (set->pages[(p - 1) * CHARSET_PAGE_BYTES + (c >> 3)] >> (c & 7)) & 1;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef CHARSET_H_
+#define CHARSET_H_
+
+#include <unicode/utf.h>
+
+#include "SDL.h"
+
+/* A set of code points, kept as a bitmap of 256 character pages. Only the
+ * pages with something in them take up memory, so a font's whole
+ * character map fits in a few kB, and looking a character up is an index
+ * and a bit test. */
+
+struct charset;
+
+struct charset* charset_new();
+void charset_free(struct charset* set);
+int charset_add(struct charset* set, UChar32 c);
+int charset_has(const struct charset* set, UChar32 c);
+
+#endif /* CHARSET_H_ */
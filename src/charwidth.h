@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CHARWIDTH_H_
+#define CHARWIDTH_H_
+
+#include <unicode/utf.h>
+
+/* Tables are generated into charwidth.c by scripts/gen-charwidth.py.
+ * Stage 1 maps each block of 256 code points to a stage 2 block, which
+ * holds a 2 bit width for each code point in the block. */
+extern const unsigned char charwidth_stage1[];
+extern const unsigned char charwidth_stage2[][64];
+
+/* Returns the number of cells taken by c on the screen:
+ * 0 for combining marks and other zero width characters,
+ * 2 for East Asian Wide and Fullwidth characters, 1 otherwise. */
+static inline int char_width(UChar32 c){
+  if(c < 0x300){
+    /* Latin, no combining marks below U+0300 */
+    return 1;
+  }
+  if(c > 0x10FFFF){
+    return 1;
+  }
+  return (charwidth_stage2[charwidth_stage1[c >> 8]][(c & 0xff) >> 2] >> ((c & 3) << 1)) & 3;
+}
+
+#endif /* CHARWIDTH_H_ */
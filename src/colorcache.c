@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "terminal.h"
+
+#include "colorcache.h"
+
+#define COLORCACHE_BUCKETS 64
+
+struct color_entry {
+  UChar32 c;
+  Uint32* pixels;  /* NULL if c turned out to have no colour bitmap */
+  size_t bytes;
+  struct color_entry* bucket_next;
+  struct color_entry* newer;
+  struct color_entry* older;
+};
+
+static struct color_entry* buckets[COLORCACHE_BUCKETS];
+static struct color_entry* newest = NULL;
+static struct color_entry* oldest = NULL;
+static size_t used_bytes = 0;
+static size_t max_bytes = 0;
+static int glyph_w = 0;
+static int glyph_h = 0;
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long evictions = 0;
+
+/* cell_w and cell_h are the size of one character cell */
+int colorcache_init(int cell_w, int cell_h, size_t max){
+  colorcache_flush();
+  glyph_w = 2 * cell_w;
+  glyph_h = cell_h;
+  max_bytes = max;
+  PRINT(stderr, "Colour glyph cache: %lu kB of %dx%d glyphs\n", (unsigned long)(max / 1024), glyph_w, glyph_h);
+  return TERM_SUCCESS;
+}
+
+void colorcache_uninit(){
+  PRINT(stderr, "Colour glyph cache: %lu hits, %lu misses, %lu evictions\n", hits, misses, evictions);
+  colorcache_flush();
+  max_bytes = 0;
+}
+
+static void colorcache_free(struct color_entry* e){
+  used_bytes -= e->bytes;
+  free(e->pixels);
+  free(e);
+}
+
+/* forget every glyph */
+void colorcache_flush(){
+  struct color_entry* e = newest;
+  while(e != NULL){
+    struct color_entry* next = e->older;
+    colorcache_free(e);
+    e = next;
+  }
+  memset(buckets, 0, sizeof(buckets));
+  newest = NULL;
+  oldest = NULL;
+  used_bytes = 0;
+}
+
+/* pixels between rows of a glyph */
+int colorcache_pitch(){
+  return glyph_w;
+}
+
+static void lru_unlink(struct color_entry* e){
+  if(e->newer != NULL){ e->newer->older = e->older; } else { newest = e->older; }
+  if(e->older != NULL){ e->older->newer = e->newer; } else { oldest = e->newer; }
+  e->newer = NULL;
+  e->older = NULL;
+}
+
+static void lru_push(struct color_entry* e){
+  e->newer = NULL;
+  e->older = newest;
+  if(newest != NULL){ newest->newer = e; }
+  newest = e;
+  if(oldest == NULL){ oldest = e; }
+}
+
+static void bucket_unlink(struct color_entry* e){
+  struct color_entry** p = &buckets[(Uint32)e->c % COLORCACHE_BUCKETS];
+  while(*p != NULL){
+    if(*p == e){
+      *p = e->bucket_next;
+      return;
+    }
+    p = &(*p)->bucket_next;
+  }
+}
+
+static struct color_entry* colorcache_entry(UChar32 c){
+  struct color_entry* e;
+  for(e = buckets[(Uint32)c % COLORCACHE_BUCKETS]; e != NULL; e = e->bucket_next){
+    if(e->c == c){
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/* Returns the pixels of c, colorcache_pitch() pixels apart, or NULL.
+ * *found is set if c is in the cache at all: a NULL return with *found
+ * set means c has no colour bitmap, and is drawn from the atlas. */
+const Uint32* colorcache_find(UChar32 c, char* found){
+  struct color_entry* e = colorcache_entry(c);
+  *found = e != NULL;
+  if(e == NULL){
+    ++misses;
+    return NULL;
+  }
+  lru_unlink(e);
+  lru_push(e);
+  ++hits;
+  return e->pixels;
+}
+
+/* Returns cleared pixels for c, to be filled in by the caller, or NULL
+ * if the cache is off or out of memory. c must not be in the cache. */
+Uint32* colorcache_add(UChar32 c){
+  size_t pixel_bytes = (size_t)glyph_w * glyph_h * sizeof(Uint32);
+  size_t bytes = sizeof(struct color_entry) + pixel_bytes;
+  struct color_entry* e;
+
+  if(bytes > max_bytes){
+    return NULL;
+  }
+  while(used_bytes + bytes > max_bytes && oldest != NULL){
+    e = oldest;
+    lru_unlink(e);
+    bucket_unlink(e);
+    colorcache_free(e);
+    ++evictions;
+  }
+
+  e = (struct color_entry*)calloc(1, sizeof(struct color_entry));
+  if(e == NULL){
+    return NULL;
+  }
+  e->pixels = (Uint32*)calloc(1, pixel_bytes);
+  if(e->pixels == NULL){
+    free(e);
+    return NULL;
+  }
+  e->c = c;
+  e->bytes = bytes;
+  used_bytes += bytes;
+  e->bucket_next = buckets[(Uint32)c % COLORCACHE_BUCKETS];
+  buckets[(Uint32)c % COLORCACHE_BUCKETS] = e;
+  lru_push(e);
+  return e->pixels;
+}
+
+/* Remember that c, just added, has no colour bitmap after all, so it
+ * isn't tried again. Its pixels are freed. */
+void colorcache_no_color(UChar32 c){
+  struct color_entry* e = colorcache_entry(c);
+  if(e == NULL || e->pixels == NULL){
+    return;
+  }
+  free(e->pixels);
+  e->pixels = NULL;
+  used_bytes -= e->bytes - sizeof(struct color_entry);
+  e->bytes = sizeof(struct color_entry);
+}
+
+/* Whether c is in the cache, or would go in without a glyph being
+ * dropped to make room. Pixels from colorcache_find() stay put as long
+ * as this holds for everything added after them. */
+int colorcache_fits(UChar32 c){
+  size_t bytes = sizeof(struct color_entry) + (size_t)glyph_w * glyph_h * sizeof(Uint32);
+  return bytes > max_bytes || used_bytes + bytes <= max_bytes || colorcache_entry(c) != NULL;
+}
+
+/* Blend w x h glyph pixels over 32 bit pixels with whole byte channels.
+ * dst_pitch and src_pitch are in pixels. */
+void colorcache_blend_32(Uint32* dst, int dst_pitch, const Uint32* src, int src_pitch,
+                         int w, int h, const SDL_PixelFormat* fmt){
+  int i, j;
+  for(j = 0; j < h; ++j){
+    const Uint32* s = src + j * src_pitch;
+    Uint32* d = dst + j * dst_pitch;
+    for(i = 0; i < w; ++i){
+      Uint32 p = s[i];
+      Uint32 a = p >> 24;
+      Uint32 r = (p >> 16) & 0xff;
+      Uint32 g = (p >> 8) & 0xff;
+      Uint32 b = p & 0xff;
+      if(a == 0){
+        continue;
+      }
+      if(a != 255){
+        /* premultiplied, so only the destination is scaled */
+        Uint32 q = d[i];
+        r += (((q >> fmt->Rshift) & 0xff) * (255 - a) + 127) / 255;
+        g += (((q >> fmt->Gshift) & 0xff) * (255 - a) + 127) / 255;
+        b += (((q >> fmt->Bshift) & 0xff) * (255 - a) + 127) / 255;
+      }
+      d[i] = (d[i] & fmt->Amask) | r << fmt->Rshift | g << fmt->Gshift | b << fmt->Bshift;
+    }
+  }
+}
+
+static Uint32 get_pixel(const Uint8* p, int bytes){
+  switch(bytes){
+    case 4: return *(const Uint32*)p;
+    case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+      return p[0] << 16 | p[1] << 8 | p[2];
+#else
+      return p[0] | p[1] << 8 | p[2] << 16;
+#endif
+    case 2: return *(const Uint16*)p;
+    default: return *p;
+  }
+}
+
+static void put_pixel(Uint8* p, int bytes, Uint32 pixel){
+  switch(bytes){
+    case 4: *(Uint32*)p = pixel; break;
+    case 3:
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+      p[0] = pixel >> 16; p[1] = pixel >> 8; p[2] = pixel;
+#else
+      p[0] = pixel; p[1] = pixel >> 8; p[2] = pixel >> 16;
+#endif
+      break;
+    case 2: *(Uint16*)p = (Uint16)pixel; break;
+    default: *p = (Uint8)pixel; break;
+  }
+}
+
+/* Blend a glyph's pixels over w x h pixels of dst at x,y */
+void colorcache_blit(SDL_Surface* dst, int x, int y, int w, int h, const Uint32* pixels){
+  int i, j;
+  int pitch = glyph_w;
+  SDL_PixelFormat* fmt = dst->format;
+
+  /* clip */
+  if(w > glyph_w){ w = glyph_w; }
+  if(h > glyph_h){ h = glyph_h; }
+  if(x < 0){ pixels -= x; w += x; x = 0; }
+  if(y < 0){ pixels -= y * pitch; h += y; y = 0; }
+  if(x + w > dst->w){ w = dst->w - x; }
+  if(y + h > dst->h){ h = dst->h - y; }
+  if(w <= 0 || h <= 0){
+    return;
+  }
+
+  if(SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0){
+    return;
+  }
+  if(fmt->BytesPerPixel == 4 && fmt->Rloss == 0 && fmt->Gloss == 0 && fmt->Bloss == 0 &&
+     fmt->Rshift % 8 == 0 && fmt->Gshift % 8 == 0 && fmt->Bshift % 8 == 0){
+    colorcache_blend_32((Uint32*)((Uint8*)dst->pixels + y * dst->pitch) + x, dst->pitch / 4,
+                        pixels, pitch, w, h, fmt);
+  } else {
+    /* anything else, 16 and 24 bit screens included, a pixel at a time */
+    int bytes = fmt->BytesPerPixel;
+    for(j = 0; j < h; ++j){
+      const Uint32* s = pixels + j * pitch;
+      Uint8* d = (Uint8*)dst->pixels + (y + j) * dst->pitch + x * bytes;
+      for(i = 0; i < w; ++i, d += bytes){
+        Uint32 a = s[i] >> 24;
+        Uint8 r, g, b;
+        if(a == 0){
+          continue;
+        }
+        SDL_GetRGB(get_pixel(d, bytes), fmt, &r, &g, &b);
+        put_pixel(d, bytes, SDL_MapRGB(fmt,
+                                       ((s[i] >> 16) & 0xff) + (r * (255 - a) + 127) / 255,
+                                       ((s[i] >> 8) & 0xff) + (g * (255 - a) + 127) / 255,
+                                       (s[i] & 0xff) + (b * (255 - a) + 127) / 255));
+      }
+    }
+  }
+  if(SDL_MUSTLOCK(dst)){
+    SDL_UnlockSurface(dst);
+  }
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef COLORCACHE_H_
+#define COLORCACHE_H_
+
+#include <unicode/utf.h>
+
+#include "SDL.h"
+
+/* The colour glyph cache keeps colour emoji, which the coverage masks of
+ * the glyph atlas can't hold. Each one is drawn once, scaled to two cells
+ * as it goes in, and kept as premultiplied 0xAARRGGBB pixels that are
+ * blended over the cell backgrounds as they are, never scaled again.
+ * Glyphs are kept in least recently used order under their own memory
+ * limit, apart from the atlas. */
+
+int colorcache_init(int cell_w, int cell_h, size_t max_bytes);
+void colorcache_uninit();
+void colorcache_flush();
+int colorcache_pitch();
+const Uint32* colorcache_find(UChar32 c, char* found);
+Uint32* colorcache_add(UChar32 c);
+void colorcache_no_color(UChar32 c);
+int colorcache_fits(UChar32 c);
+
+void colorcache_blend_32(Uint32* dst, int dst_pitch, const Uint32* src, int src_pitch,
+                         int w, int h, const SDL_PixelFormat* fmt);
+void colorcache_blit(SDL_Surface* dst, int x, int y, int w, int h, const Uint32* pixels);
+
+#endif /* COLORCACHE_H_ */
@@ -17,6 +17,7 @@
 #include <sys/keycodes.h>
 #include <unicode/utf.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -28,7 +29,8 @@
 #include "terminal.h"
 #include "buffer.h"
 #include "io.h"
-#include "colors.h"
+#include "palette.h"
+#include "charwidth.h"
 
 #include "ecma48.h"
 
@@ -51,6 +53,12 @@ static char state = ECMA48_STATE_NORMAL;
 
 static char writing_buffer = BUFFER_NORMAL;
 
+/* the OSC string so far, and whether BEL ended it rather than ST */
+#define OSC_MAX 512
+static char osc_string[OSC_MAX];
+static int osc_len = 0;
+static char osc_bel = 0;
+
 static char autowrap = 1;
 static char rautowrap = 0;
 
@@ -92,7 +100,8 @@ struct ecma48_modes {
 };
 
 static struct ecma48_modes modes;
-static UChar last_char;
+static UChar32 last_char;
+static UChar lead_surrogate;
 
 /* from buffer.c */
 extern buf_t* buf;
@@ -101,8 +110,9 @@ extern int cols;
 extern struct scroll_region sr;
 extern char ** tabs;
 
-/* from main.c */
+/* from render.c */
 extern char draw_cursor;
+extern char cursor_blink;
 extern char flash;
 extern struct font_style default_text_style;
 
@@ -134,7 +144,7 @@ void ecma48_parameter_arg_next(){
 void ecma48_clear_display(){
 	int i = 0;
 	for(i=0; i<rows; ++i){
-		buf_erase_line(buf->text[buf->top_line + i], cols);
+		buf_clear_line(buf->text[buf->top_line + i], cols);
 	}
 }
 
@@ -220,40 +230,109 @@ void ecma48_end_control(){
 	ecma48_escape_args_init();
 }
 
+/* write c at the cursor position, taking care of its width */
+static void ecma48_put_char(UChar32 c){
+  struct screenchar *line;
+  struct screenchar *sc;
+  int width = char_width(c);
+
+  if(width == 0){
+    /* combining marks belong to the character before the cursor */
+    if(buf->col > 0){
+      int mark_col = buf->col - 1;
+      line = buf->text[buf->line];
+      if(line[mark_col].wide == SC_WIDE_RIGHT && mark_col > 0){
+        --mark_col;
+      }
+      buf_add_combining(&line[mark_col], c);
+      buf_mark_dirty(line, mark_col, line[mark_col].wide ? 2 : 1);
+    }
+    return;
+  }
+  /* double width and double height lines hold half as many chars */
+  int line_cols = buf_line_info(buf->text[buf->line])->size == LINE_SINGLE_WIDTH ? cols : cols / 2;
+  if(line_cols < 2){
+    /* nowhere to put the second half */
+    width = 1;
+  }
+
+  // check if we are being asked to write beyond the screen
+  // if so, the program is not handling wrapping, so we wrap.
+  // double width chars that don't fit on the line wrap as well
+  if(buf->col + width > line_cols) {
+    if(autowrap){ // wrap
+      buf_increment_line();
+      buf->col = 0;
+    } else { // no autowrap means no wrapping
+      // overwrite last char
+      buf->col = line_cols > width ? line_cols - width : 0;
+    }
+  }
+  if(modes.IRM){
+    /* INSERT Mode - insert a blank before doing the usual thing */
+    buf_insert_character(0);
+    if(width == 2){
+      buf_insert_character(0);
+    }
+  }
+  line = buf->text[buf->line];
+  buf_split_wide_char(line, buf->col);
+  if(width == 2){
+    buf_split_wide_char(line, buf->col + 1);
+  }
+  sc = &(line[buf->col++]);
+
+  /* free old char */
+  buf_free_char(sc);
+  /* write new one */
+  sc->c = c;
+  sc->wide = width == 2 ? SC_WIDE_LEFT : 0;
+  sc->style = buf->current_style;
+  if(buf->current_style.reverse){
+    /* reverse the fg and bg */
+    SDL_Color temp = sc->style.fg_color;
+    sc->style.fg_color = sc->style.bg_color;
+    sc->style.bg_color = temp;
+  }
+  if(width == 2){
+    /* and mark the cell the right half covers */
+    struct screenchar *right = &(line[buf->col++]);
+    buf_free_char(right);
+    right->c = ' ';
+    right->wide = SC_WIDE_RIGHT;
+    right->style = sc->style;
+  }
+  buf_mark_dirty(line, buf->col - width, width);
+  /* cache for REP */
+  last_char = c;
+}
+
 void ecma48_add_char(UChar c){
 
   if(writing_buffer == BUFFER_NORMAL){
-    // check if we are being asked to write beyond the screen
-    // if so, the program is not handling wrapping, so we wrap
-  	if(buf->col == cols) {
-			if(autowrap){ // wrap
-				buf_increment_line();
-				buf->col = 0;
-			} else { // no autowrap means no wrapping
-				// overwrite last char
-				buf->col = cols -1;
-			}
-		}
-  	if(modes.IRM){
-  	  /* INSERT Mode - insert a blank before doing the usual thing */
-  	  buf_insert_character(0);
-  	}
-    struct screenchar *sc = &(buf->text[buf->line][buf->col++]);
-
-    /* free old char */
-    buf_free_char(sc);
-    /* write new one */
-    sc->c = c;
-    sc->style = buf->current_style;
-    if(buf->current_style.reverse){
-      /* reverse the fg and bg */
-      SDL_Color temp = sc->style.fg_color;
-      sc->style.fg_color = sc->style.bg_color;
-      sc->style.bg_color = temp;
+    /* put surrogate pairs back together, and show the halves that
+     * don't pair up as the replacement character */
+    if(U16_IS_LEAD(c)){
+      if(lead_surrogate){
+        ecma48_put_char(0xFFFD);
+      }
+      lead_surrogate = c;
+      return;
+    }
+    if(U16_IS_TRAIL(c) && lead_surrogate){
+      ecma48_put_char(U16_GET_SUPPLEMENTARY(lead_surrogate, c));
+    } else {
+      if(lead_surrogate){
+        ecma48_put_char(0xFFFD);
+      }
+      ecma48_put_char(U16_IS_TRAIL(c) ? 0xFFFD : c);
+    }
+    lead_surrogate = 0;
+  } else if(writing_buffer == BUFFER_OSC){
+    if(c >= 0x20 && c < 0x7f && osc_len < OSC_MAX - 1){
+      osc_string[osc_len++] = (char)c;
     }
-    /* cache for REP */
-    last_char = c;
-  } /* else { BUFFER_OSC, etc. -> ignore for now } */
+  } /* else { BUFFER_DCS, etc. -> ignore for now } */
 }
 
 int ecma48_RETURN(UChar* tbuf){
@@ -647,6 +726,7 @@ void ecma48_BEL(){
   ecma48_PRINT_CONTROL_SEQUENCE("BEL");
   if(writing_buffer != BUFFER_NORMAL){
     /* BEL is used as ST sometimes... */
+    osc_bel = 1;
     ecma48_ST();
   } else {
     /* expected use */
@@ -1411,6 +1491,103 @@ void setstate_CSI(){
   state = ECMA48_STATE_CSI;
 }
 
+/* Answer an OSC colour query for palette entry n, as
+ * ESC ] prefix rgb:rrrr/gggg/bbbb, ended the way the query was */
+static void ecma48_osc_color_reply(const char* prefix, int n){
+  char spec[32];
+  char reply[64];
+  palette_format(palette_get(n), spec, sizeof(spec));
+  int len = snprintf(reply, sizeof(reply), "\033]%s%s%s", prefix, spec, osc_bel ? "\a" : "\033\\");
+  if(len > 0 && len < (int)sizeof(reply)){
+    io_write_master_char(reply, len);
+  }
+}
+
+/* OSC 4 ; c ; spec ... - set or, with a spec of ?, query palette colours */
+static void ecma48_osc_set_colors(char* args){
+  char* save;
+  char* index = strtok_r(args, ";", &save);
+  while(index != NULL){
+    char* spec = strtok_r(NULL, ";", &save);
+    char* end;
+    SDL_Color rgb;
+    long n = strtol(index, &end, 10);
+    if(spec == NULL){
+      break;
+    }
+    if(end != index && *end == '\0' && BETWEEN(n, 0, 255)){
+      if(strcmp(spec, "?") == 0){
+        char prefix[16];
+        snprintf(prefix, sizeof(prefix), "4;%ld;", n);
+        ecma48_osc_color_reply(prefix, (int)n);
+      } else if(palette_parse(spec, &rgb) == TERM_SUCCESS){
+        palette_set((int)n, rgb);
+      }
+    }
+    index = strtok_r(NULL, ";", &save);
+  }
+}
+
+/* OSC 10 and 11 ; spec ... - set or query the default foreground and
+ * background. Further specs carry on to the next colour, as in xterm;
+ * the ones past the background (cursor colour and so on) are ignored. */
+static void ecma48_osc_set_defaults(int cmd, char* args){
+  char* save;
+  char* spec;
+  SDL_Color rgb;
+  for(spec = strtok_r(args, ";", &save); spec != NULL && cmd <= 11;
+      spec = strtok_r(NULL, ";", &save), ++cmd){
+    int n = cmd == 10 ? PALETTE_FG : PALETTE_BG;
+    if(strcmp(spec, "?") == 0){
+      char prefix[16];
+      snprintf(prefix, sizeof(prefix), "%d;", cmd);
+      ecma48_osc_color_reply(prefix, n);
+    } else if(palette_parse(spec, &rgb) == TERM_SUCCESS){
+      palette_set(n, rgb);
+    }
+  }
+}
+
+/* OSC 104 ; c ... - reset the given palette colours, or all of them */
+static void ecma48_osc_reset_colors(char* args){
+  char* save;
+  char* index = strtok_r(args, ";", &save);
+  if(index == NULL){
+    palette_reset_all();
+    return;
+  }
+  for(; index != NULL; index = strtok_r(NULL, ";", &save)){
+    char* end;
+    long n = strtol(index, &end, 10);
+    if(end != index && *end == '\0' && BETWEEN(n, 0, 255)){
+      palette_reset((int)n);
+    }
+  }
+}
+
+/* Act on a complete OSC string, Ps ; Pt. Only the colour
+ * commands are handled; window titles and the rest are ignored. */
+static void ecma48_osc_dispatch(char* str){
+  char* args;
+  long cmd = strtol(str, &args, 10);
+  if(args == str || (*args != ';' && *args != '\0')){
+    NIPRINT(stderr, "-- Invalid OSC: %s\n", str);
+    return;
+  }
+  if(*args == ';'){
+    ++args;
+  }
+  switch(cmd){
+    case 4: ecma48_osc_set_colors(args); break;
+    case 10:
+    case 11: ecma48_osc_set_defaults((int)cmd, args); break;
+    case 104: ecma48_osc_reset_colors(args); break;
+    case 110: palette_reset(PALETTE_FG); break;
+    case 111: palette_reset(PALETTE_BG); break;
+    default: NIPRINT(stderr, "-- Unhandled OSC: %ld\n", cmd); break;
+  }
+}
+
 /*
 ST - STRING TERMINATOR
 Notation: (C1)
@@ -1421,7 +1598,12 @@ PROGRAM COMMAND (APC), DEVICE CONTROL STRING (DCS), OPERATING SYSTEM COMMAND
 */
 void ecma48_ST(){
   ecma48_PRINT_CONTROL_SEQUENCE("ST");
+  if(writing_buffer == BUFFER_OSC){
+    osc_string[osc_len] = '\0';
+    ecma48_osc_dispatch(osc_string);
+  }
   writing_buffer = BUFFER_NORMAL;
+  osc_bel = 0;
   ecma48_end_control();
 }
 
@@ -1438,6 +1620,7 @@ command string depends on the relevant operating system.
 void ecma48_OSC(){
   ecma48_PRINT_CONTROL_SEQUENCE("OSC");
   writing_buffer = BUFFER_OSC;
+  osc_len = 0;
   ecma48_end_control();
 }
 
@@ -1523,6 +1706,7 @@ void ecma48_RIS(){
   buf_reset_text_buffer(buf);
   clear_all_char_tabstops();
   buf_clear_all_vtabs();
+  palette_reset_all();
   sr.top = 1;
   sr.bottom = rows;
   ecma48_end_control();
@@ -1634,9 +1818,23 @@ parameter value of SET LINE HOME (SLH).
 void ecma48_ICH(){
   ecma48_PRINT_CONTROL_SEQUENCE("ICH");
   int Pn = escape_args.args[0][0] != '\0' ? (int)strtol(escape_args.args[0], NULL, 10) : 1;
+  if(Pn < 1){
+    /* 0 means the default */
+    Pn = 1;
+  }
+  struct screenchar* line = buf->text[buf->line];
+  /* don't shift half of a double width character away from the other
+   * half, at the cursor or where characters fall off the line */
+  buf_split_wide_char(line, buf->col);
   if(!modes.HEM){
+    if(Pn < cols - buf->col){
+      buf_split_wide_char(line, cols - Pn);
+    }
     buf_insert_character_following(Pn);
   } else {
+    if(Pn <= buf->col){
+      buf_split_wide_char(line, Pn - 1);
+    }
     buf_insert_character_preceding(Pn);
   }
   /* FIXME: Handle SLH and SEE? */
@@ -1903,15 +2101,15 @@ void ecma48_ED(){
   int Pn = escape_args.args[0][0] != '\0' ? (int)strtol(escape_args.args[0], NULL, 10) : 0;
   switch (Pn) {
     case 0: // from cursor to end of screen
-      buf_erase_line(&buf->text[buf->line][buf->col], (cols-buf->col));
+      buf_erase_span(buf->text[buf->line], buf->col, (cols-buf->col));
       for(i=(buf->line-buf->top_line + 1); i < rows; ++i){
-        buf_erase_line(buf->text[buf->top_line + i], cols );
+        buf_clear_line(buf->text[buf->top_line + i], cols );
       }
       break;
     case 1: // from top of screen to cursor
       buf_erase_line(buf->text[buf->line], (buf->col+1));
       for(i= 0; i < (buf->line-buf->top_line); ++i){
-        buf_erase_line(buf->text[buf->top_line + i], cols);
+        buf_clear_line(buf->text[buf->top_line + i], cols);
       }
       break;
     case 2: // entire screen
@@ -1956,7 +2154,7 @@ void ecma48_EL(){
   int Pn = escape_args.args[0][0] != '\0' ? (int)strtol(escape_args.args[0], NULL, 10) : 0;
   switch (Pn) {
     case 0: // from cursor to end of line
-      buf_erase_line(&buf->text[buf->line][buf->col], (cols-buf->col));
+      buf_erase_span(buf->text[buf->line], buf->col, (cols-buf->col));
       break;
     case 1: // from start of line to cursor
       buf_erase_line(buf->text[buf->line], (buf->col+1));
@@ -2014,9 +2212,10 @@ void ecma48_IL(){
     }
     // and insert blank line
     buf->text[buf->line] = tmp;
-    buf_erase_line(buf->text[buf->line], cols);
+    buf_clear_line(buf->text[buf->line], cols);
     ++i;
   } while (i < Pn);
+  buf_note_scroll(buf->line - buf->top_line, sr.bottom, -i);
   buf->col = 0;
   ecma48_end_control();
 }
@@ -2066,9 +2265,10 @@ void ecma48_DL(){
     }
     // and insert blank line
     buf->text[buf->top_line + sr.bottom - 1] = tmp;
-    buf_erase_line(buf->text[buf->top_line + sr.bottom - 1], cols);
+    buf_clear_line(buf->text[buf->top_line + sr.bottom - 1], cols);
     ++i;
   } while (i < Pn);
+  buf_note_scroll(buf->line - buf->top_line, sr.bottom, i);
   buf->col = 0;
   ecma48_end_control();
 }
@@ -2163,9 +2363,21 @@ of the shifted part, n character positions are put into the erased state.
 void ecma48_DCH(){
   ecma48_PRINT_CONTROL_SEQUENCE("DCH");
   int Pn = escape_args.args[0][0] != '\0' ? (int)strtol(escape_args.args[0], NULL, 10) : 1;
+  if(Pn < 1){
+    /* 0 means the default */
+    Pn = 1;
+  }
+  struct screenchar* line = buf->text[buf->line];
+  /* a double width character across either end of the deleted
+   * cells goes as a whole */
+  buf_split_wide_char(line, buf->col);
   if(!modes.HEM){
+    Pn = Pn > cols - buf->col ? cols - buf->col : Pn;
+    buf_split_wide_char(line, buf->col + Pn - 1);
     buf_delete_character_following(Pn);
   } else {
+    Pn = Pn > buf->col + 1 ? buf->col + 1 : Pn;
+    buf_split_wide_char(line, buf->col - Pn + 1);
     buf_delete_character_preceding(Pn);
   }
   ecma48_end_control();
@@ -2239,9 +2451,10 @@ void ecma48_SU(){
     }
     // and insert blank line
     buf->text[buf->top_line + sr.bottom -1] = tmp;
-    buf_erase_line(buf->text[buf->top_line + sr.bottom -1], cols);
+    buf_clear_line(buf->text[buf->top_line + sr.bottom -1], cols);
     ++i;
   } while (i < Pn);
+  buf_note_scroll(sr.top - 1, sr.bottom, i);
   ecma48_end_control();
 }
 
@@ -2279,9 +2492,10 @@ void ecma48_SD(){
     }
     // and insert blank line
     buf->text[buf->top_line + sr.top -1] = tmp;
-    buf_erase_line(buf->text[buf->top_line + sr.top -1], cols);
+    buf_clear_line(buf->text[buf->top_line + sr.top -1], cols);
     ++i;
   } while (i < Pn);
+  buf_note_scroll(sr.top - 1, sr.bottom, -i);
   ecma48_end_control();
 }
 
@@ -2356,7 +2570,12 @@ void ecma48_ECH(){
   /* Make sure not to overrun the end of the line */
   int max = cols - buf->col;
   Pn = Pn > max ? max : Pn;
-  buf_erase_line(&buf->text[buf->line][buf->col], Pn);
+  if(Pn > 0){
+    /* no half characters left at either end */
+    buf_split_wide_char(buf->text[buf->line], buf->col);
+    buf_split_wide_char(buf->text[buf->line], buf->col + Pn - 1);
+  }
+  buf_erase_span(buf->text[buf->line], buf->col, Pn);
   ecma48_end_control();
 }
 
@@ -2587,7 +2806,7 @@ void ecma48_REP(){
   int Pn = escape_args.args[0][0] != '\0' ? (int)strtol(escape_args.args[0], NULL, 10) : 1;
   int i = 0;
   for(i = 0; i < Pn; ++i){
-    ecma48_add_char(last_char);
+    ecma48_put_char(last_char);
   }
   ecma48_end_control();
   //ecma48_NOT_IMPLEMENTED("REP");
@@ -2985,8 +3204,8 @@ void ecma48_SGR(){
           buf->current_style.style |= TTF_STYLE_UNDERLINE;
           break;
         case 5: // 5 slowly blinking (less then 150 per minute)
-          break;
         case 6: // 6 rapidly blinking (150 per minute or more)
+          buf->current_style.blink = 1;
           break;
         case 7: // 7 negative image
           ecma48_reverse_video();
@@ -3032,6 +3251,7 @@ void ecma48_SGR(){
           buf->current_style.style ^= TTF_STYLE_UNDERLINE;
           break;
         case 25: // 25 steady (not blinking)
+          buf->current_style.blink = 0;
           break;
         case 26: break;
         case 27: // 27 positive image
@@ -3043,28 +3263,28 @@ void ecma48_SGR(){
           buf->current_style.style ^= TTF_STYLE_STRIKETHROUGH;
           break;
         case 30: // 30 black display [0,0,0] b [127,127,127]
-          buf->current_style.fg_color = (SDL_Color)SDL_BLACK;
+          buf->current_style.fg_color = palette_ref(0);
           break;
         case 31: // 31 red display [205,0,0] b [255,0,0]
-          buf->current_style.fg_color = (SDL_Color)SDL_RED;
+          buf->current_style.fg_color = palette_ref(1);
           break;
         case 32: // 32 green display [0,205,0] b [0,255,0]
-          buf->current_style.fg_color = (SDL_Color)SDL_GREEN;
+          buf->current_style.fg_color = palette_ref(2);
           break;
         case 33: // 33 yellow display [205,205,0] b [255,255,0]
-          buf->current_style.fg_color = (SDL_Color)SDL_YELLOW;
+          buf->current_style.fg_color = palette_ref(3);
           break;
         case 34: // 34 blue display [0,0,238] b [92,92,255]
-          buf->current_style.fg_color = (SDL_Color)SDL_BLUE;
+          buf->current_style.fg_color = palette_ref(4);
           break;
         case 35: // 35 magenta display [205,0,205] b [255,0,255]
-          buf->current_style.fg_color = (SDL_Color)SDL_MAGENTA;
+          buf->current_style.fg_color = palette_ref(5);
           break;
         case 36: // 36 cyan display [0,205,205] b [0,255,255]
-          buf->current_style.fg_color = (SDL_Color)SDL_CYAN;
+          buf->current_style.fg_color = palette_ref(6);
           break;
         case 37: // 37 white display [229,229,229] b [255,255,255]
-          buf->current_style.fg_color = (SDL_Color)SDL_WHITE;
+          buf->current_style.fg_color = palette_ref(7);
           break;
         case 38: // extended colour support
           if (i+1 < NUM_ESCAPE_ARGS) { //don't overflow
@@ -3079,7 +3299,7 @@ void ecma48_SGR(){
                 break;
               case 5: // indexed color
                 if((i+2 < NUM_ESCAPE_ARGS) && (BETWEEN(Pn[i+2], 0, 255))){
-                  buf->current_style.fg_color = (SDL_Color)term_colors[Pn[i+2]];
+                  buf->current_style.fg_color = palette_ref(Pn[i+2]);
                   i += 2;
                 }
                 break;
@@ -3093,28 +3313,28 @@ void ecma48_SGR(){
           buf->current_style.fg_color = default_text_style.fg_color;
           break;
         case 40: // 40 black background [0,0,0]
-          buf->current_style.bg_color = (SDL_Color)SDL_BLACK;
+          buf->current_style.bg_color = palette_ref(0);
           break;
         case 41: // 41 red background [205,0,0]
-          buf->current_style.bg_color = (SDL_Color)SDL_RED;
+          buf->current_style.bg_color = palette_ref(1);
           break;
         case 42: // 42 green background [0,205,0]
-          buf->current_style.bg_color = (SDL_Color)SDL_GREEN;
+          buf->current_style.bg_color = palette_ref(2);
           break;
         case 43: // 43 yellow background [205,205,0]
-          buf->current_style.bg_color = (SDL_Color)SDL_YELLOW;
+          buf->current_style.bg_color = palette_ref(3);
           break;
         case 44: // 44 blue background [0,0,238]
-          buf->current_style.bg_color = (SDL_Color)SDL_BLUE;
+          buf->current_style.bg_color = palette_ref(4);
           break;
         case 45: // 45 magenta background [205,0,205]
-          buf->current_style.bg_color = (SDL_Color)SDL_MAGENTA;
+          buf->current_style.bg_color = palette_ref(5);
           break;
         case 46: // 46 cyan background [0,205,205]
-          buf->current_style.bg_color = (SDL_Color)SDL_CYAN;
+          buf->current_style.bg_color = palette_ref(6);
           break;
         case 47: // 47 white background [255,225,255]
-          buf->current_style.bg_color = (SDL_Color)SDL_WHITE;
+          buf->current_style.bg_color = palette_ref(7);
           break;
         case 48: // extended colour support
           if (i+1 < NUM_ESCAPE_ARGS) { //don't overflow
@@ -3129,7 +3349,7 @@ void ecma48_SGR(){
                 break;
               case 5: // indexed color
                 if((i+2 < NUM_ESCAPE_ARGS) && (BETWEEN(Pn[i+2], 0, 255))){
-                  buf->current_style.bg_color = (SDL_Color)term_colors[Pn[i+2]];
+                  buf->current_style.bg_color = palette_ref(Pn[i+2]);
                   i += 2;
                 }
                 break;
@@ -3158,22 +3378,22 @@ void ecma48_SGR(){
         case 63: break; // 63 ideogram double overline or double line on the left side
         case 64: break; // 64 ideogram stress marking
         case 65: break; // 65 cancels the effect parameter values 60 to 64
-        case 90: buf->current_style.fg_color = (SDL_Color)SDL_BLACK; break;
-        case 91: buf->current_style.fg_color = (SDL_Color)SDL_RED; break;
-        case 92: buf->current_style.fg_color = (SDL_Color)SDL_GREEN; break;
-        case 93: buf->current_style.fg_color = (SDL_Color)SDL_YELLOW; break;
-        case 94: buf->current_style.fg_color = (SDL_Color)SDL_BLUE; break;
-        case 95: buf->current_style.fg_color = (SDL_Color)SDL_MAGENTA; break;
-        case 96: buf->current_style.fg_color = (SDL_Color)SDL_CYAN; break;
-        case 97: buf->current_style.fg_color = (SDL_Color)SDL_WHITE; break;
-        case 100: buf->current_style.bg_color = (SDL_Color)SDL_BLACK; break;
-        case 101: buf->current_style.bg_color = (SDL_Color)SDL_RED; break;
-        case 102: buf->current_style.bg_color = (SDL_Color)SDL_GREEN; break;
-        case 103: buf->current_style.bg_color = (SDL_Color)SDL_YELLOW; break;
-        case 104: buf->current_style.bg_color = (SDL_Color)SDL_BLUE; break;
-        case 105: buf->current_style.bg_color = (SDL_Color)SDL_MAGENTA; break;
-        case 106: buf->current_style.bg_color = (SDL_Color)SDL_CYAN; break;
-        case 107: buf->current_style.bg_color = (SDL_Color)SDL_WHITE; break;
+        case 90: buf->current_style.fg_color = palette_ref(8); break;
+        case 91: buf->current_style.fg_color = palette_ref(9); break;
+        case 92: buf->current_style.fg_color = palette_ref(10); break;
+        case 93: buf->current_style.fg_color = palette_ref(11); break;
+        case 94: buf->current_style.fg_color = palette_ref(12); break;
+        case 95: buf->current_style.fg_color = palette_ref(13); break;
+        case 96: buf->current_style.fg_color = palette_ref(14); break;
+        case 97: buf->current_style.fg_color = palette_ref(15); break;
+        case 100: buf->current_style.bg_color = palette_ref(8); break;
+        case 101: buf->current_style.bg_color = palette_ref(9); break;
+        case 102: buf->current_style.bg_color = palette_ref(10); break;
+        case 103: buf->current_style.bg_color = palette_ref(11); break;
+        case 104: buf->current_style.bg_color = palette_ref(12); break;
+        case 105: buf->current_style.bg_color = palette_ref(13); break;
+        case 106: buf->current_style.bg_color = palette_ref(14); break;
+        case 107: buf->current_style.bg_color = palette_ref(15); break;
         default: NIPRINT(stderr, " -- Unhandled SGR param: %d\n", Pn[i]);
       };
     }
@@ -3311,7 +3531,7 @@ void ansi_SM(){
         case 6:  buf->origin = 1; ecma48_set_cursor_home();break;// DECOM Set origin relative
         case 7:  autowrap = 1; break;
         case 8:  break; // DECARM ignored
-        case 12: break; // Enable very visible cursor (blinking)
+        case 12: cursor_blink = 1; break; // Start blinking cursor
         case 25: draw_cursor = 1; break;
         case 40: modes.DECCOLM = 1; break;
         case 45: rautowrap = 1; break;
@@ -3353,7 +3573,7 @@ void ansi_RM(){
         case 6:  buf->origin = 0; ecma48_set_cursor_home(); break; // DECOM Set origin absolute
         case 7:  autowrap = 0; break;
         case 8:  break; // DECARM ignored
-        case 12: break; // Disable very visible cursor (blinking)
+        case 12: cursor_blink = 0; break; // Stop blinking cursor
         case 25: draw_cursor = 0; break;
         case 40: modes.DECCOLM = 0; break;
         case 45: rautowrap = 0; break;
@@ -3408,8 +3628,24 @@ void ansi_FUNCKEY(){
   ecma48_NOT_IMPLEMENTED("FUNCKEY");
 }
 
-void ansi_LINE_SIZE(){
-  ecma48_NOT_IMPLEMENTED("LINE SIZE");
+/* DECDHL, DECSWL, DECDWL - set the size of the line holding the cursor.
+ * ESC # 3 is the top half of a double height line, ESC # 4 the bottom
+ * half, ESC # 5 single width and ESC # 6 double width. */
+void ansi_LINE_SIZE(UChar c){
+  ecma48_PRINT_CONTROL_SEQUENCE("LINE SIZE");
+  struct line_info* li = buf_line_info(buf->text[buf->line]);
+  switch(c){
+    case 0x33: li->size = LINE_DOUBLE_TOP; break;
+    case 0x34: li->size = LINE_DOUBLE_BOTTOM; break;
+    case 0x35: li->size = LINE_SINGLE_WIDTH; break;
+    case 0x36: li->size = LINE_DOUBLE_WIDTH; break;
+  }
+  buf_mark_line_dirty(buf->text[buf->line]);
+  /* double size lines hold half as many characters */
+  if(li->size != LINE_SINGLE_WIDTH && buf->col >= cols / 2){
+    buf->col = cols / 2 - 1;
+  }
+  ecma48_end_control();
 }
 
 void ansi_SC(){
@@ -3453,8 +3689,13 @@ void ansi_DECALN(){
 			/* write new one */
 			sc->c = pattern;
 			sc->style = buf->current_style;
+			sc->wide = 0;
 		}
 	}
+	for(y = 0; y < rows; ++y){
+		buf_line_info(buf->text[y])->size = LINE_SINGLE_WIDTH;
+		buf_mark_line_dirty(buf->text[y]);
+	}
 	buf->top_line = 0;
 	buf->line = 0;
 	buf->col = 0;
@@ -3732,7 +3973,7 @@ void ecma48_filter_text(UChar* tbuf, ssize_t chars){
           case 0x33:
           case 0x34:
           case 0x35:
-          case 0x36: ansi_LINE_SIZE(); break;
+          case 0x36: ansi_LINE_SIZE(tbuf[i]); break;
           case 0x38: ansi_DECALN(); break;
           default: ecma48_UNRECOGNIZED_CONTROL(tbuf[i]); break;
         }; break;
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "SDL.h"
+#include "terminal.h"
+
+#include "atlas.h"
+#include "boxdraw.h"
+#include "glyphcache.h"
+
+#define GLYPHCACHE_MAGIC 0x47383454 /* "T48G" */
+/* bump when the way masks are drawn changes */
+#define GLYPHCACHE_VERSION 2
+/* never fill more than half the atlas from the file */
+#define GLYPHCACHE_MAX_GLYPHS (ATLAS_DEFAULT_GLYPHS / 2)
+
+struct glyphcache_header {
+  Uint32 magic;
+  Uint32 version;
+  Uint32 font_id;
+  Uint32 mask_pitch;
+  Uint32 mask_h;
+  Uint32 key_size;
+  Uint32 count;
+};
+/* followed by count glyph_keys, then count masks */
+
+static size_t file_size(Uint32 count, int mask_pitch, int mask_h){
+  return sizeof(struct glyphcache_header) + count * (sizeof(struct glyph_key) + (size_t)mask_pitch * mask_h);
+}
+
+static Uint32 hash_bytes(Uint32 h, const void* data, size_t n){
+  const Uint8* p = (const Uint8*)data;
+  size_t i;
+  for(i = 0; i < n; ++i){
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+/* An id for the fonts the masks are drawn with: the name, size and
+ * modification time of each file, which is enough to notice one has been
+ * replaced, and the point size and hinting. Empty or NULL paths are
+ * faces made from the regular font. */
+Uint32 glyphcache_font_id(const char* const* font_paths, int num_paths, int size, int hinting){
+  struct stat st;
+  Uint32 id = 2166136261u;
+  int i;
+  for(i = 0; i < num_paths; ++i){
+    const char* path = font_paths[i] != NULL ? font_paths[i] : "";
+    id = hash_bytes(id, path, strlen(path) + 1);
+    if(path[0] != '\0' && stat(path, &st) == 0){
+      id = hash_bytes(id, &st.st_size, sizeof(st.st_size));
+      id = hash_bytes(id, &st.st_mtime, sizeof(st.st_mtime));
+    }
+  }
+  id = hash_bytes(id, &size, sizeof(size));
+  id = hash_bytes(id, &hinting, sizeof(hinting));
+  return id;
+}
+
+/* Copy the glyphs in the cache file into the atlas. Returns the number
+ * of glyphs loaded, 0 if the file is missing or doesn't match. */
+int glyphcache_load(const char* path, Uint32 font_id, int mask_pitch, int mask_h){
+  struct stat st;
+  const struct glyphcache_header* header;
+  const struct glyph_key* keys;
+  const Uint8* masks;
+  size_t mask_size = (size_t)mask_pitch * mask_h;
+  void* map;
+  Uint32 i;
+  int loaded = 0;
+
+  int fd = open(path, O_RDONLY);
+  if(fd < 0){
+    return 0;
+  }
+  if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct glyphcache_header)){
+    close(fd);
+    return 0;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED){
+    return 0;
+  }
+
+  header = (const struct glyphcache_header*)map;
+  if(header->magic != GLYPHCACHE_MAGIC || header->version != GLYPHCACHE_VERSION ||
+     header->font_id != font_id || header->mask_pitch != (Uint32)mask_pitch ||
+     header->mask_h != (Uint32)mask_h || header->key_size != sizeof(struct glyph_key) ||
+     header->count > GLYPHCACHE_MAX_GLYPHS ||
+     (size_t)st.st_size != file_size(header->count, mask_pitch, mask_h)){
+    PRINT(stderr, "Glyph cache %s is for another font, ignoring it\n", path);
+    munmap(map, st.st_size);
+    return 0;
+  }
+  keys = (const struct glyph_key*)(header + 1);
+  masks = (const Uint8*)(keys + header->count);
+  for(i = 0; i < header->count; ++i){
+    if(atlas_find(&keys[i]) != NULL){
+      continue;
+    }
+    Uint8* mask = atlas_add(&keys[i]);
+    if(mask != NULL){
+      memcpy(mask, masks + i * mask_size, mask_size);
+      ++loaded;
+    }
+  }
+  munmap(map, st.st_size);
+  PRINT(stderr, "Glyph cache: loaded %d glyphs from %s\n", loaded, path);
+  return loaded;
+}
+
+struct glyphcache_writer {
+  struct glyph_key* keys;
+  const Uint8** masks;
+  Uint32 count;
+};
+
+/* Box drawing is drawn when the font loads, and glyphs with marks are
+ * rare enough not to be worth keeping */
+static void collect_glyph(const struct glyph_key* key, const Uint8* mask, void* data){
+  struct glyphcache_writer* w = (struct glyphcache_writer*)data;
+  if(w->count == GLYPHCACHE_MAX_GLYPHS || key->marks[0] != 0 || boxdraw_has(key->c)){
+    return;
+  }
+  w->keys[w->count] = *key;
+  w->masks[w->count] = mask;
+  ++w->count;
+}
+
+/* Write the glyphs in the atlas to the cache file. The file is written
+ * next to path and renamed over it, so a reader never sees half of it. */
+int glyphcache_save(const char* path, Uint32 font_id, int mask_pitch, int mask_h){
+  struct glyphcache_header header;
+  struct glyphcache_writer w;
+  char tmp_path[256];
+  size_t mask_size = (size_t)mask_pitch * mask_h;
+  Uint32 i;
+  FILE* f;
+  int ok;
+
+  memset(&w, 0, sizeof(w));
+  w.keys = (struct glyph_key*)calloc(GLYPHCACHE_MAX_GLYPHS, sizeof(struct glyph_key));
+  w.masks = (const Uint8**)calloc(GLYPHCACHE_MAX_GLYPHS, sizeof(Uint8*));
+  if(w.keys == NULL || w.masks == NULL){
+    free(w.keys);
+    free(w.masks);
+    return TERM_FAILURE;
+  }
+  atlas_each(collect_glyph, &w);
+
+  memset(&header, 0, sizeof(header));
+  header.magic = GLYPHCACHE_MAGIC;
+  header.version = GLYPHCACHE_VERSION;
+  header.font_id = font_id;
+  header.mask_pitch = mask_pitch;
+  header.mask_h = mask_h;
+  header.key_size = sizeof(struct glyph_key);
+  header.count = w.count;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  f = fopen(tmp_path, "wb");
+  ok = f != NULL;
+  ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+  ok = ok && fwrite(w.keys, sizeof(struct glyph_key), w.count, f) == w.count;
+  for(i = 0; ok && i < w.count; ++i){
+    ok = fwrite(w.masks[i], 1, mask_size, f) == mask_size;
+  }
+  if(f != NULL && fclose(f) != 0){
+    ok = 0;
+  }
+  if(ok && rename(tmp_path, path) != 0){
+    ok = 0;
+  }
+  free(w.keys);
+  free(w.masks);
+  if(!ok){
+    fprintf(stderr, "Couldn't write glyph cache %s\n", path);
+    unlink(tmp_path);
+    return TERM_FAILURE;
+  }
+  PRINT(stderr, "Glyph cache: saved %u glyphs to %s\n", (unsigned int)w.count, path);
+  return TERM_SUCCESS;
+}
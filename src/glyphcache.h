@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GLYPHCACHE_H_
+#define GLYPHCACHE_H_
+
+#include "SDL.h"
+
+/* The glyph cache file keeps masks from the glyph atlas between launches,
+ * so the glyphs drawn last time don't go through FreeType again. The file
+ * is mapped and copied into the atlas when the font loads, and is only
+ * used if its font id and mask size match: the id covers the font files,
+ * their size and the hinting, so changing any of them starts over. */
+
+#define GLYPHCACHE_FILE_PATH ".term48glyphs"
+
+Uint32 glyphcache_font_id(const char* const* font_paths, int num_paths, int size, int hinting);
+int glyphcache_load(const char* path, Uint32 font_id, int mask_pitch, int mask_h);
+int glyphcache_save(const char* path, Uint32 font_id, int mask_pitch, int mask_h);
+
+#endif /* GLYPHCACHE_H_ */
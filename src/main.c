@@ -20,11 +20,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/select.h>
 
 #include <bps/screen.h>
 #include <bps/virtualkeyboard.h>
 #include <bps/deviceinfo.h>
+#include <bps/battery.h>
 #include <unicode/utf.h>
 
 #include "SDL.h"
@@ -38,53 +40,28 @@
 #include "preferences.h"
 #include "buffer.h"
 #include "io.h"
-#include "colors.h"
+#include "render.h"
 
 static int exit_application = 0;
 
 static char slave_ptyname[L_ctermid];
 
-static int cursor_x = 0;
-static int cursor_y = 0;
-char draw_cursor = 1;
-
-char flash = 0;
-
-static pref_t *prefs = NULL;
-static symmenu_t *current_symmenu = NULL;
+pref_t *prefs = NULL;
+symmenu_t *current_symmenu = NULL;
 
 static char symmenu_lock = 0;
-static char altsym_lock = 0;
+char altsym_lock = 0;
 
-static char metamode = 0;
+char metamode = 0;
 static int metamode_doubletap_key = 0;
 static struct timespec metamode_last;
-static SDL_Color metamode_cursor_fg = SDL_BLACK;
-static SDL_Color metamode_cursor_bg = SDL_GREEN;
-static SDL_Surface* metamode_cursor;
-static int vmodifiers = 0;
-
-static TTF_Font* font;
-static int text_width;
-static int text_height;
-static int text_height_padding;
-static int advance;
-static int default_text_color_arr[PREFS_COLOR_NUM_ELEMENTS];
-static int default_bg_color_arr[PREFS_COLOR_NUM_ELEMENTS];
-static SDL_Color default_text_color = SDL_WHITE;
-static SDL_Color default_bg_color = SDL_BLACK;
-struct font_style default_text_style;
-
-struct screenchar blank_sc;
-static SDL_Surface* flash_surface;
-static SDL_Surface* cursor;
-static SDL_Surface* inv_cursor;
-static SDL_Surface* screen;
-static SDL_Surface* ctrl_key_indicator;
-static SDL_Surface* alt_key_indicator;
-static SDL_Surface* shift_key_indicator;
-static SDL_Surface* altsym_indicator;
-SDL_Surface* blank_surface;
+int vmodifiers = 0;
+
+/* held while a frame is drawn, and while the screen, fonts or
+ * screen size change under it */
+static SDL_mutex *render_mutex = NULL;
+static void lock_render();
+static void unlock_render();
 
 static pid_t child_pid = -1;
 
@@ -103,8 +80,18 @@ extern int MAX_COLS;
 extern int MAX_ROWS;
 extern int TEXT_BUFFER_SIZE;
 extern struct scroll_region sr;
+extern char full_damage;
+extern struct scroll_damage scroll_damage;
 
-#define PB_D_PIXELS 32
+/* from render.c */
+extern char cursor_blink;
+extern SDL_Surface* screen;
+extern int text_width;
+extern int text_height;
+
+/* Single buffered, so a partial update with SDL_UpdateRects
+ * leaves the rest of the previous frame on the screen */
+#define PB_VIDEO_FLAGS SDL_SWSURFACE
 
 int is_terminfo_keystrokes(const char* keystrokes){
 	if(keystrokes[0] == 'k'){
@@ -209,7 +196,10 @@ void symmenu_stick(){
 	symmenu_lock = 1;
 }
 
+/* Called with the input lock held. Resizing the screen changes what
+ * render_frame() draws from, so the render lock is taken for it too. */
 void symmenu_toggle(symmenu_t *target){
+	lock_render();
 	if (current_symmenu == NULL){
 		current_symmenu = target;
 		// resize to show menu
@@ -227,6 +217,7 @@ void symmenu_toggle(symmenu_t *target){
 		}
 		symmenu_lock = 0;
 	}
+	unlock_render();
 }
 
 static const char* symkey_for_mousedown(symmenu_t *menu, Uint16 x, Uint16 y) {
@@ -251,138 +242,6 @@ static const char* symkey_for_mousedown(symmenu_t *menu, Uint16 x, Uint16 y) {
 	return NULL;
 }
 
-int font_init(int font_size){
-	if(font_size < MIN_FONT_SIZE){
-		fprintf(stderr, "Refusing to set font size to %d - too small\n",font_size);
-		int default_font_columns = (atoi(getenv("WIDTH")) <= 720) ? 45 : 60;
-		font_size = preferences_guess_best_font_size(prefs, default_font_columns);
-	}
-
-	/* Load the font */
-	font = TTF_OpenFont(prefs->font_path, font_size);
-	if ( font == NULL ) {
-		/* try opening the default stuff */
-		fprintf(stderr, "Couldn't load %d pt font from %s: %s\n", font_size, prefs->font_path, SDL_GetError());
-		font = TTF_OpenFont(DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
-		if(font == NULL){
-			fprintf(stderr, "Could not open default font %s: %s\n", DEFAULT_FONT_PATH, SDL_GetError());
-			return TERM_FAILURE;
-		}
-	}
-	PRINT(stderr, "Font is Fixed Width: %d\n", TTF_FontFaceIsFixedWidth(font));
-
-	/* Set default options */
-	TTF_SetFontStyle(font, TTF_STYLE_NORMAL);
-	TTF_SetFontOutline(font, 0);
-	TTF_SetFontKerning(font, 0);
-	TTF_SetFontHinting(font, TTF_HINTING_NORMAL);
-
-	/* get default colour settings from prefs struct*/
-	default_text_color.r = (Uint8)prefs->text_color[0];
-	default_text_color.g = (Uint8)prefs->text_color[1];
-	default_text_color.b = (Uint8)prefs->text_color[2];
-	default_text_color.unused = 0;
-	
-	default_bg_color.r = (Uint8)prefs->background_color[0];
-	default_bg_color.g = (Uint8)prefs->background_color[1];
-	default_bg_color.b = (Uint8)prefs->background_color[2];
-	default_bg_color.unused = 0;
-
-	default_text_style.fg_color = default_text_color;
-	default_text_style.bg_color = default_bg_color;
-	default_text_style.style = TTF_STYLE_NORMAL;
-	default_text_style.reverse = 0;
-
-	/* initialize special characters */
-	UChar str[2] = {' ', NULL};
-	blank_surface = TTF_RenderUNICODE_Shaded(font, str, default_text_color, default_bg_color);
-	if (blank_surface == NULL){
-		PRINT(stderr, "Couldn't render blank surface: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	blank_sc.c = ' ';
-	blank_sc.style = default_text_style;
-	blank_sc.surface = blank_surface;
-	flash_surface = TTF_RenderUNICODE_Shaded(font, str, default_bg_color, default_text_color);
-	if (flash_surface == NULL){
-		PRINT(stderr, "Couldn't render flash surface: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	str[0] = 'A';
-	alt_key_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
-	if (alt_key_indicator == NULL){
-		PRINT(stderr, "Couldn't render alt_key_indicator surface: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	str[0] = 'C';
-	ctrl_key_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
-	if (ctrl_key_indicator == NULL){
-		PRINT(stderr, "Couldn't render ctrl_key_indicator surface: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	str[0] = 0x2191;
-	shift_key_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
-	if (shift_key_indicator == NULL){
-		PRINT(stderr, "Couldn't render shift_key_indicator surface: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	str[0] = 'a';
-	altsym_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
-	if (shift_key_indicator == NULL){
-		PRINT(stderr, "Couldn't render altsym_indicator surface: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	str[0] = 'M';
-	metamode_cursor = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
-	if (metamode_cursor == NULL){
-		PRINT(stderr, "Couldn't render metamode_cursor surface: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	/* Initialize the cursor */
-	UChar cursorstr[2] = {' ', NULL};
-	cursor = TTF_RenderUNICODE_Shaded(font, cursorstr, default_bg_color, default_text_color);
-	if (cursor == NULL){
-		PRINT(stderr, "Couldn't render cursor char: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	/* Get the size of the font */
-	int minx, maxx, miny, maxy;
-	if(TTF_GlyphMetrics(font, (Uint16)'X', &minx, &maxx, &miny, &maxy, &advance) != 0){
-		PRINT(stderr, "Could not get Glyph Metrics: %s\n", TTF_GetError());
-		return TERM_FAILURE;
-	}
-
-	text_width = advance;
-	text_height = maxy - miny;
-	text_height_padding = TTF_FontLineSkip(font) - text_height;
-	text_height += text_height_padding;
-	PRINT(stderr, "Character h: %d w:%d (h padding: %d) advance: %d\n", text_height, text_width, text_height_padding, advance);
-
-	return TERM_SUCCESS;
-}
-
-void font_uninit(){
-
-	SDL_FreeSurface(blank_surface);
-	SDL_FreeSurface(flash_surface);
-	SDL_FreeSurface(metamode_cursor);
-	SDL_FreeSurface(ctrl_key_indicator);
-	SDL_FreeSurface(alt_key_indicator);
-	SDL_FreeSurface(shift_key_indicator);
-	SDL_FreeSurface(cursor);
-	if(font != NULL){
-		TTF_CloseFont(font);
-	}
-}
-
 void handle_activeevent(int gain, int state){
 	if (gain && prefs->auto_show_vkb){
 		PRINT(stderr, "Got ActiveEvent - initializing keyboard\n");
@@ -419,6 +278,7 @@ void handle_virtualkeyboard_event(bps_event_t *event){
 
 	vkb_h = get_virtualkeyboard_height();
 
+	lock_render();
 	switch (event_code){
 	case VIRTUALKEYBOARD_EVENT_VISIBLE:
 		setup_screen_size(resolution[0], resolution[1] - vkb_h);
@@ -436,6 +296,7 @@ void handle_virtualkeyboard_event(bps_event_t *event){
 		fprintf(stderr, "Unknown keyboard event code %d\n", event_code);
 		break;
 	}
+	unlock_render();
 }
 
 void rescreen(int w, int h){
@@ -443,11 +304,10 @@ void rescreen(int w, int h){
 	int width  = w == -1 ? screen->w : w;
 	int height = h == -1 ? screen->h : h;
 	int vkb_h = 0;
-	screen = SDL_SetVideoMode(width, height, PB_D_PIXELS, SDL_HWSURFACE | SDL_DOUBLEBUF);
+	lock_render();
+	screen = SDL_SetVideoMode(width, height, PB_D_PIXELS, PB_VIDEO_FLAGS);
 	/* reset the font size as well */
-	font_uninit();
-	buf_clear_all_renders();
-	if(font_init(prefs->font_size) == TERM_FAILURE){
+	if(font_resize(prefs->font_size) == TERM_FAILURE){
 		fprintf(stderr, "Couldn't initialize font\n");
 		exit_application = 1;
 	}
@@ -457,6 +317,7 @@ void rescreen(int w, int h){
 		vkb_h = get_virtualkeyboard_height();
 		setup_screen_size(width, height - vkb_h);
 	}
+	unlock_render();
 }
 
 void toggle_vkeymod(int mod){
@@ -797,6 +658,10 @@ void setup_screen_size(int s_w, int s_h){
 	int old_bottom_line = buf_bottom_line();
 	rows = s_h / text_height;
 	cols = s_w / text_width;
+	/* the buffer has room for cells of MIN_FONT_SIZE pixels, a font
+	 * with smaller ones only gets the rows and columns that fit */
+	rows = rows < MAX_ROWS ? rows : MAX_ROWS;
+	cols = cols < MAX_COLS ? cols : MAX_COLS;
 	int diff_rows = rows - old_rows;
 	PRINT(stderr, "Rows: %d Cols: %d\n", rows, cols);
 
@@ -841,6 +706,20 @@ void unlock_input(){
 	}
 }
 
+/* Taken after the input lock, never before it */
+static void lock_render(){
+	if(SDL_LockMutex(render_mutex) == -1){
+		fprintf(stderr, "Couldn't lock render mutex - exiting\n");
+		exit_application = 1;
+	}
+}
+static void unlock_render(){
+	if(SDL_UnlockMutex(render_mutex) == -1){
+		fprintf(stderr, "Couldn't unlock render mutex - exiting\n");
+		exit_application = 1;
+	}
+}
+
 void indicate_event_input(){
 	char *indicate_buf = "w";
 	/* indicate that the render thread should run. Note that
@@ -856,30 +735,73 @@ void indicate_event_input(){
 void set_screen_cols(int ncols){
 	/* the user wants this number of columns */
 	if (prefs->allow_resize_columns) {
+		lock_render();
 		int new_fontsize = preferences_guess_best_font_size(prefs, ncols);
-		font_uninit();
-		buf_clear_all_renders();
-		if(font_init(new_fontsize) == TERM_FAILURE){
+		if(font_resize(new_fontsize) == TERM_FAILURE){
 			fprintf(stderr, "Error setting new font size\n");
 			exit_application = 1;
 		} else {
 			setup_screen_size(screen->w, screen->h);
 			/* and force the number of columns */
-			cols = ncols;
+			cols = ncols < MAX_COLS ? ncols : MAX_COLS;
 			set_tty_window_size();
 		}
+		unlock_render();
 	}
 }
 
-static int sdl_init() {
+static int input_init() {
 	/* init the input mutex */
 	input_mutex = SDL_CreateMutex();
+	render_mutex = SDL_CreateMutex();
 	
 	/* init the event input pipe */
 	if(pipe(event_pipe) == -1){
 		fprintf(stderr, "Couldn't create event pipe\n");
 		return TERM_FAILURE;
 	}
+	return TERM_SUCCESS;
+}
+
+/* Set up the text buffer and renderer to fit screen */
+static int screen_init() {
+	/* we allocate as much buffer as we will ever need */
+	int largest_dimension = screen->w > screen->h ? screen->w : screen->h;
+	MAX_ROWS = largest_dimension / MIN_FONT_SIZE;
+	MAX_COLS = largest_dimension / MIN_FONT_SIZE;
+	TEXT_BUFFER_SIZE = MAX_ROWS * 2;
+	fprintf(stderr, "Allocating %d rows and %d cols\n",TEXT_BUFFER_SIZE, MAX_COLS);
+
+	/* initialize the number of rows and columns */
+	rows = screen->h / text_height;
+	cols = screen->w / text_width;
+	rows = rows < MAX_ROWS ? rows : MAX_ROWS;
+	cols = cols < MAX_COLS ? cols : MAX_COLS;
+
+	if(buf_init() == TERM_FAILURE){
+		PRINT(stderr, "Couldn't initialize font\n");
+		return TERM_FAILURE;
+	}
+
+	if(render_init() == TERM_FAILURE){
+		PRINT(stderr, "Couldn't initialize renderer\n");
+		return TERM_FAILURE;
+	}
+
+	setup_screen_size(screen->w, screen->h);
+	
+	/* and set the last 'press' */
+	clock_gettime(CLOCK_MONOTONIC, &metamode_last);
+
+	ecma48_init();
+
+	return TERM_SUCCESS;
+}
+
+static int sdl_init() {
+	if(input_init() == TERM_FAILURE){
+		return TERM_FAILURE;
+	}
 
 	/* Initialize SDL */
 	if (SDL_Init(SDL_INIT_VIDEO) < 0 ) {
@@ -935,7 +857,7 @@ static int sdl_init() {
 		}
 	}
 
-	screen = SDL_SetVideoMode(wm_size[0], wm_size[1], PB_D_PIXELS, SDL_HWSURFACE | SDL_DOUBLEBUF);
+	screen = SDL_SetVideoMode(wm_size[0], wm_size[1], PB_D_PIXELS, PB_VIDEO_FLAGS);
 	if ( screen == NULL ) {
 		PRINT(stderr, "Couldn't set %d x %d x %d video mode: %s\n", wm_size[0], wm_size[1], PB_D_PIXELS, SDL_GetError());
 		TTF_Quit();
@@ -953,39 +875,22 @@ static int sdl_init() {
 	/* Don't show the mouse icon */
 	SDL_ShowCursor(SDL_DISABLE);
 
-	/* we allocate as much buffer as we will ever need */
-	int largest_dimension = screen->w > screen->h ? screen->w : screen->h;
-	MAX_ROWS = largest_dimension / MIN_FONT_SIZE;
-	MAX_COLS = largest_dimension / MIN_FONT_SIZE;
-	TEXT_BUFFER_SIZE = MAX_ROWS * 2;
-	fprintf(stderr, "Allocating %d rows and %d cols\n",TEXT_BUFFER_SIZE, MAX_COLS);
-
-	/* initialize the number of rows and columns */
-	rows = screen->h / text_height;
-	cols = screen->w / text_width;
-
-	if(buf_init() == TERM_FAILURE){
-		PRINT(stderr, "Couldn't initialize font\n");
+	if(screen_init() == TERM_FAILURE){
 		TTF_Quit();
 		SDL_Quit();
 		return TERM_FAILURE;
 	}
 
-	setup_screen_size(screen->w, screen->h);
-	
-	/* and set the last 'press' */
-	clock_gettime(CLOCK_MONOTONIC, &metamode_last);
-
-	ecma48_init();
-
 	return TERM_SUCCESS;
 }
 
 void uninit(){
 
 	buf_uninit();
+	render_uninit();
 
 	SDL_DestroyMutex(input_mutex);
+	SDL_DestroyMutex(render_mutex);
 
 	font_uninit();
 	SDL_FreeSurface(screen);
@@ -1000,188 +905,6 @@ void uninit(){
 	io_uninit();
 }
 
-SDL_Color adjust_color(SDL_Color in, struct font_style sty){
-	int i;
-	if(sty.style & TTF_STYLE_BOLD){
-		for(i = 0; i < 8; ++i){
-			if((in.b == term_colors[i].b) &&
-			   (in.g == term_colors[i].g) &&
-			   (in.r == term_colors[i].r)){
-				in = term_colors[i+8];
-				break;
-			}
-		}
-	}
-	return in;
-}
-
-void render() {
-
-	int offset;
-	struct screenchar* sc;
-	SDL_Surface* torender;
-	UChar str[2];
-	str[1] = NULL;
-
-	/* Set the background */
-	SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, default_bg_color.r, default_bg_color.g, default_bg_color.b));
-
-	for(int i = 0; i < rows; ++i){
-		float x = 0.0;
-		float y = text_height * (i);
-		
-		for(int j = 0; j < cols; ++j){
-			/* guard against screen rotations that push the bottom of the screen past the
-			 * bottom of the buffer. */
-			sc = i+buf->top_line < TEXT_BUFFER_SIZE ? &buf->text[i+buf->top_line][j] : &blank_sc;
-			if((sc->surface == NULL) && (sc->c != 0)){
-				// we have added a new char, but not rendered it yet
-				str[0] = sc->c;
-				TTF_SetFontStyle(font, sc->style.style);
-				if(buf->inverse_video){
-					sc->surface = TTF_RenderUNICODE_Shaded(font, str, adjust_color(sc->style.bg_color, sc->style), sc->style.fg_color);
-				} else {
-					sc->surface = TTF_RenderUNICODE_Shaded(font, str, adjust_color(sc->style.fg_color, sc->style), sc->style.bg_color);
-				}
-				if(sc->surface == NULL){
-					PRINT(stderr, "Rendering failed for char %d\n", (int)sc->c);
-				}
-			}
-			if(sc->surface == NULL || flash){
-				// no glyph here - render blank
-				if(buf->inverse_video){
-					torender = flash ? blank_surface : flash_surface;
-				} else {
-					torender = flash ? flash_surface : blank_surface;
-				}
-			} else {
-				torender = sc->surface;
-			}
-
-			/* construct the destination rectangle */
-			SDL_Rect destrect;
-			destrect.x = x;
-			destrect.y = y;
-			destrect.w = torender->w;
-			destrect.h = torender->h;
-			if(SDL_BlitSurface(torender, NULL, screen, &destrect) != 0){
-				PRINT(stderr, "Blit Failed: %s\n", SDL_GetError());
-			}
-			x += advance;
-		}
-	}
-
-	if (draw_cursor){
-		// draw the cursor
-		/* Free the old cursor if we have one */
-		SDL_FreeSurface(inv_cursor);
-		inv_cursor = NULL;
-		/* Get the character under the cursor */
-
-		int drawcols = buf->col;
-		if(buf->col == cols){
-			// Don't draw off the edge - also make backspace from the right margin work 'right'
-			drawcols -= 1;
-		}
-
-		sc = &buf->text[buf->line][drawcols];
-		if(sc->c){
-			str[0] = sc->c;
-			TTF_SetFontStyle(font, sc->style.style);
-			if(buf->inverse_video){
-				inv_cursor = TTF_RenderUNICODE_Shaded(font, str, adjust_color(sc->style.fg_color, sc->style), sc->style.bg_color);
-			} else {
-				inv_cursor = TTF_RenderUNICODE_Shaded(font, str, adjust_color(sc->style.bg_color, sc->style), sc->style.fg_color);
-			}
-			if(inv_cursor == NULL){
-				PRINT(stderr, "Rendering failed for char %d\n", (int)sc->c);
-			}
-		}
-		cursor_x = drawcols;
-		cursor_y = buf->line - buf->top_line;
-
-		SDL_Rect destrect;
-		destrect.x = cursor_x * advance;
-		destrect.y = cursor_y * text_height;
-		destrect.w = cursor->w;
-		destrect.h = cursor->h;
-		if(inv_cursor != NULL){
-			SDL_BlitSurface(inv_cursor, NULL, screen, &destrect);
-		} else {
-			SDL_BlitSurface(buf->inverse_video ? blank_surface: cursor, NULL, screen, &destrect);
-		}
-	}
-
-	if(metamode && metamode_cursor != NULL){
-		/* draw the metamode cursor */
-		SDL_Rect destrect;
-		destrect.x = (cols-1) * advance;
-		destrect.y = 0;
-		destrect.w = metamode_cursor->w;
-		destrect.h = metamode_cursor->h;
-		SDL_BlitSurface(metamode_cursor, NULL, screen, &destrect);
-	}
-
-	if(vmodifiers & KEYMOD_CTRL){
-		SDL_Rect destrect;
-		destrect.x = (cols-1) * advance;
-		destrect.y = 1 * text_height;
-		destrect.w = ctrl_key_indicator->w;
-		destrect.h = ctrl_key_indicator->h;
-		SDL_BlitSurface(ctrl_key_indicator, NULL, screen, &destrect);
-	}
-
-	if(vmodifiers & KEYMOD_ALT){
-		SDL_Rect destrect;
-		destrect.x = (cols-1) * advance;
-		destrect.y = 2 * text_height;
-		destrect.w = alt_key_indicator->w;
-		destrect.h = alt_key_indicator->h;
-		SDL_BlitSurface(alt_key_indicator, NULL, screen, &destrect);
-	}
-
-	if(vmodifiers & KEYMOD_SHIFT){
-		SDL_Rect destrect;
-		destrect.x = (cols-1) * advance;
-		destrect.y = 3 * text_height;
-		destrect.w = shift_key_indicator->w;
-		destrect.h = shift_key_indicator->h;
-		SDL_BlitSurface(shift_key_indicator, NULL, screen, &destrect);
-	}
-
-	if (altsym_lock) {
-		SDL_Rect destrect;
-		destrect.x = (cols-1) * advance;
-		destrect.y = 3 * text_height;
-		destrect.w = shift_key_indicator->w;
-		destrect.h = shift_key_indicator->h;
-		SDL_BlitSurface(altsym_indicator, NULL, screen, &destrect);
-	}
-
-	if ((current_symmenu != NULL) && (current_symmenu->surface != NULL)) {
-		/* blit symmenu surface */
-		SDL_Rect destrect;
-		destrect.w = current_symmenu->surface->w;
-		destrect.h = current_symmenu->surface->h;
-		destrect.x = 0;
-		destrect.y = screen->h - current_symmenu->surface->h;;
-	
-		if (SDL_BlitSurface(current_symmenu->surface, NULL, screen, &destrect) != 0) {
-			PRINT(stderr, "Symmenu blit failed: %s\n", SDL_GetError());
-			return;
-		}
-	}
-
-	SDL_Flip(screen);
-
-	if(flash){
-		/* turn it off */
-		flash = 0;
-		/* write to the input pipe so we run again */
-		indicate_event_input();
-	}
-
-}
 
 static int pty_init() {
 	// Set up the ttys and fork
@@ -1322,6 +1045,46 @@ void sig_child(int signo){
  * for either input event indication or data from the
  * shell, then run the render loop
  */
+/* Frame pacing. The render thread draws at most one frame per frame
+ * interval, however fast output and events come in, and everything that
+ * arrives in between goes into the next frame. The first change after a
+ * quiet spell is drawn straight away, and a change that arrives too soon
+ * is drawn when its interval is up, whether or not more input follows. */
+#define BATTERY_POLL_NSEC (10 * 1000000000ULL)
+static uint64_t last_frame_t = 0;
+static uint64_t battery_checked_t = 0;
+static char on_battery = 0;
+
+/* Whether the device is running off its battery, asked again every so often */
+static int running_on_battery(uint64_t now_t){
+	battery_info_t* info = NULL;
+	if(battery_checked_t != 0 && now_t - battery_checked_t < BATTERY_POLL_NSEC){
+		return on_battery;
+	}
+	battery_checked_t = now_t;
+	if(battery_get_info(&info) == BPS_SUCCESS){
+		on_battery = battery_info_get_charger_info(info) == BATTERY_CHARGER_NONE;
+		battery_free_info(&info);
+	}
+	return on_battery;
+}
+
+/* Nanoseconds until the next frame may be drawn, 0 if it may be drawn now */
+static uint64_t frame_wait(){
+	uint64_t now_t = now_nsec();
+	int rate = prefs->frame_rate;
+	if(prefs->battery_frame_rate > 0 && running_on_battery(now_t) &&
+	   (rate <= 0 || prefs->battery_frame_rate < rate)){
+		rate = prefs->battery_frame_rate;
+	}
+	if(rate <= 0){
+		/* no limit */
+		return 0;
+	}
+	uint64_t due_t = last_frame_t + 1000000000ULL / rate;
+	return now_t < due_t ? due_t - now_t : 0;
+}
+
 int run_render(void* data){
 
 	fd_set fds;
@@ -1330,31 +1093,57 @@ int run_render(void* data){
 	UChar lbuf[READ_BUFFER_SIZE];
 	ssize_t num_chars = 0;
 	int master = io_get_master();
+	char pending = 1;
+	struct timeval timeout;
 	while(!exit_application){
+		uint64_t wait_t = timer_wait();
+		uint64_t frame_t = pending ? frame_wait() : TIMER_NONE;
+		if(frame_t < wait_t){
+			wait_t = frame_t;
+		}
 		FD_ZERO(&fds);
 		FD_SET(master, &fds);
 		FD_SET(event_pipe[0], &fds);
-		n = select(1+max(master, event_pipe[0]), &fds, NULL, NULL, NULL);
+		/* with a frame waiting or a timer running, only sleep until it is due */
+		timeout.tv_sec = wait_t / 1000000000ULL;
+		timeout.tv_usec = (wait_t % 1000000000ULL) / 1000;
+		n = select(1+max(master, event_pipe[0]), &fds, NULL, NULL, wait_t != TIMER_NONE ? &timeout : NULL);
 		if(n < 0){
 			printf("Error calling select on inputs: %d\n", errno);
-		} else {
+		} else if(n > 0){
 			if(FD_ISSET(master, &fds)){
-				lock_input();
-				// Read anything from the child
-				while ((num_chars = io_read_master(lbuf, READ_BUFFER_SIZE)) > 0){
-					ecma48_filter_text(lbuf, num_chars);
-				}
-				unlock_input();
+				// Read anything from the child, a chunk at a time so
+				// keystrokes get in between, until a frame is due
+				do {
+					lock_input();
+					num_chars = io_read_master(lbuf, READ_BUFFER_SIZE);
+					if(num_chars > 0){
+						ecma48_filter_text(lbuf, num_chars);
+					}
+					unlock_input();
+				} while(num_chars > 0 && frame_wait() > 0);
 			}
 			if(FD_ISSET(event_pipe[0], &fds)){
 				// Just read the stuff and throw it away
 				read(event_pipe[0], (void*)ev_buf, 99);
 			}
+			pending = 1;
+		}
+		if(run_timers()){
+			pending = 1;
+		}
+		if(!pending || frame_wait() > 0){
+			continue;
 		}
 		PRINT(stderr, "Render Loop\n");
+		last_frame_t = now_nsec();
+		pending = 0;
 		lock_input();
-		render();
+		render_snapshot();
+		lock_render();
 		unlock_input();
+		render_frame();
+		unlock_render();
 	}
 	/* never reached */
 	return 0;
@@ -1368,6 +1157,7 @@ int main(int argc, char **argv) {
 	if(home != NULL){ chdir(home); }
 	
 	prefs = read_preferences(PREFS_FILE_PATH);
+	cursor_blink = prefs->cursor_blink;
 	if (is_passport()) {
 		prefs->auto_show_vkb = 1;
 	}
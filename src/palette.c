@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "SDL.h"
+#include "terminal.h"
+#include "colors.h"
+
+#include "palette.h"
+
+static SDL_Color defaults[PALETTE_SIZE];
+static SDL_Color colors[PALETTE_SIZE];
+static unsigned int serial = 0;
+
+/* SGR 30-37 and 40-47 have always drawn these, full intensity white
+ * included, so the first 8 entries start from them rather than from
+ * the 256 colour table */
+static const SDL_Color base_colors[8] = {
+  SDL_BLACK, SDL_RED, SDL_GREEN, SDL_YELLOW, SDL_BLUE, SDL_MAGENTA, SDL_CYAN, SDL_WHITE
+};
+
+/* fg and bg are the default colours from the preferences */
+void palette_init(SDL_Color fg, SDL_Color bg){
+  SDL_Color fresh[PALETTE_SIZE];
+  memcpy(fresh, term_colors, sizeof(term_colors));
+  memcpy(fresh, base_colors, sizeof(base_colors));
+  fresh[PALETTE_FG] = fg;
+  fresh[PALETTE_BG] = bg;
+  /* a new font size with the same theme keeps what the application set */
+  if(serial != 0 && memcmp(fresh, defaults, sizeof(fresh)) == 0){
+    return;
+  }
+  memcpy(defaults, fresh, sizeof(fresh));
+  palette_reset_all();
+}
+
+SDL_Color palette_get(int n){
+  return colors[n];
+}
+
+void palette_set(int n, SDL_Color rgb){
+  if(n < 0 || n >= PALETTE_SIZE){
+    return;
+  }
+  rgb.unused = COLOR_RGB;
+  if(memcmp(&colors[n], &rgb, sizeof(rgb)) != 0){
+    colors[n] = rgb;
+    ++serial;
+  }
+}
+
+void palette_reset(int n){
+  if(n >= 0 && n < PALETTE_SIZE){
+    palette_set(n, defaults[n]);
+  }
+}
+
+void palette_reset_all(){
+  memcpy(colors, defaults, sizeof(colors));
+  ++serial;
+}
+
+/* Changes whenever the palette does */
+unsigned int palette_serial(){
+  return serial;
+}
+
+/* Copy the whole palette, PALETTE_SIZE colours, to colors */
+void palette_copy(SDL_Color* copy){
+  memcpy(copy, colors, sizeof(colors));
+}
+
+/* Read n hex digits from str into *value */
+static int parse_hex(const char* str, int n, unsigned int* value){
+  *value = 0;
+  for(int i = 0; i < n; ++i){
+    if(!isxdigit((unsigned char)str[i])){
+      return TERM_FAILURE;
+    }
+    *value = *value * 16 + (isdigit((unsigned char)str[i]) ? str[i] - '0' : tolower((unsigned char)str[i]) - 'a' + 10);
+  }
+  return TERM_SUCCESS;
+}
+
+/* Parse an X11 colour spec, as OSC 4, 10 and 11 take them: rgb:r/g/b
+ * with 1 to 4 hex digits a channel, scaled to 8 bits, or #rgb with
+ * 1 to 4 digits a channel, of which the top 8 bits are used. */
+int palette_parse(const char* spec, SDL_Color* rgb){
+  unsigned int v[3];
+  int i, n;
+  if(strncmp(spec, "rgb:", 4) == 0){
+    spec += 4;
+    for(i = 0; i < 3; ++i){
+      n = 0;
+      while(spec[n] != '\0' && spec[n] != '/'){
+        ++n;
+      }
+      if(n < 1 || n > 4 || parse_hex(spec, n, &v[i]) == TERM_FAILURE ||
+         (i < 2 && spec[n] != '/') || (i == 2 && spec[n] != '\0')){
+        return TERM_FAILURE;
+      }
+      v[i] = (v[i] * 255 + ((1u << (4 * n)) - 1) / 2) / ((1u << (4 * n)) - 1);
+      spec += n + 1;
+    }
+  } else if(spec[0] == '#'){
+    ++spec;
+    n = (int)strlen(spec) / 3;
+    if(n < 1 || n > 4 || (int)strlen(spec) != 3 * n){
+      return TERM_FAILURE;
+    }
+    for(i = 0; i < 3; ++i){
+      if(parse_hex(spec + i * n, n, &v[i]) == TERM_FAILURE){
+        return TERM_FAILURE;
+      }
+      v[i] = n == 1 ? v[i] << 4 : v[i] >> (4 * (n - 2));
+    }
+  } else {
+    /* no colour names */
+    return TERM_FAILURE;
+  }
+  rgb->r = (Uint8)v[0];
+  rgb->g = (Uint8)v[1];
+  rgb->b = (Uint8)v[2];
+  rgb->unused = COLOR_RGB;
+  return TERM_SUCCESS;
+}
+
+/* Write rgb as a spec palette_parse() reads back, the way xterm
+ * answers colour queries: rgb:rrrr/gggg/bbbb */
+void palette_format(SDL_Color rgb, char* str, size_t len){
+  snprintf(str, len, "rgb:%02x%02x/%02x%02x/%02x%02x", rgb.r, rgb.r, rgb.g, rgb.g, rgb.b, rgb.b);
+}
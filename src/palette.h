@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PALETTE_H_
+#define PALETTE_H_
+
+#include <stddef.h>
+
+#include "SDL.h"
+
+/* Cells keep the colours the application asked for. SGR 38;2 gives a
+ * colour of its own, but the 16 and 256 colour SGRs and the default
+ * colours refer to an entry in the palette, which the application can
+ * change later with OSC 4, 10 and 11. The renderer looks references up
+ * when it draws, so a palette change is a repaint and nothing more.
+ *
+ * The kind of colour goes in the unused byte of the SDL_Color, and a
+ * reference to one of the 256 colours keeps its index in r. */
+#define COLOR_RGB 0
+#define COLOR_INDEXED 1
+#define COLOR_DEFAULT_FG 2
+#define COLOR_DEFAULT_BG 3
+
+/* the 256 colours, then the default foreground and background */
+#define PALETTE_FG 256
+#define PALETTE_BG 257
+#define PALETTE_SIZE 258
+
+#define PALETTE_REF_FG {.r = 0, .g = 0, .b = 0, .unused = COLOR_DEFAULT_FG}
+#define PALETTE_REF_BG {.r = 0, .g = 0, .b = 0, .unused = COLOR_DEFAULT_BG}
+
+/* A reference to palette entry n */
+static inline SDL_Color palette_ref(int n){
+  SDL_Color c = {0, 0, 0, COLOR_INDEXED};
+  if(n == PALETTE_FG){
+    c.unused = COLOR_DEFAULT_FG;
+  } else if(n == PALETTE_BG){
+    c.unused = COLOR_DEFAULT_BG;
+  } else {
+    c.r = (Uint8)n;
+  }
+  return c;
+}
+
+/* The palette entry c refers to, or -1 if it is a colour of its own */
+static inline int palette_entry(SDL_Color c){
+  switch(c.unused){
+    case COLOR_INDEXED: return c.r;
+    case COLOR_DEFAULT_FG: return PALETTE_FG;
+    case COLOR_DEFAULT_BG: return PALETTE_BG;
+    default: return -1;
+  }
+}
+
+void palette_init(SDL_Color fg, SDL_Color bg);
+SDL_Color palette_get(int n);
+void palette_set(int n, SDL_Color rgb);
+void palette_reset(int n);
+void palette_reset_all();
+unsigned int palette_serial();
+void palette_copy(SDL_Color* colors);
+int palette_parse(const char* spec, SDL_Color* rgb);
+void palette_format(SDL_Color rgb, char* str, size_t len);
+
+#endif /* PALETTE_H_ */
@@ -238,6 +238,29 @@ static keymap_t* create_keymap_array(config_t const *config, char const *path, s
 	return result;
 }
 
+static char** create_string_array(config_t const *config, char const *path, size_t def_len, char const **def) {
+	config_setting_t *setting = config_lookup(config, path);
+	int use_default = 0;
+	size_t source_len = 0;
+
+	if (!setting || (config_setting_type(setting) != CONFIG_TYPE_ARRAY)) {
+		source_len = def_len;
+		use_default = 1;
+	} else {
+		source_len = config_setting_length(setting);
+	}
+
+	char **result = calloc(source_len + 1, sizeof(char*));
+	result[source_len] = NULL; // sentinel for end of array
+
+	for (int i = 0; i < source_len; i++) {
+		char const *str = use_default ? def[i] : config_setting_get_string_elem(setting, i);
+		result[i] = strdup(str != NULL ? str : "");
+	}
+
+	return result;
+}
+
 static symmenu_t* create_symmenu(config_t const *config, char const *path, int def_num_rows, int const *def_row_lens, keymap_t const *def_entries) {
 	config_setting_t *rows_s = config_lookup(config, path);
 	int use_default = 0;
@@ -354,7 +377,11 @@ static hitbox_t* create_hitbox(config_t const *config, char const *path, hitbox_
 
 void destroy_preferences(pref_t *pref) {
 	free(pref->font_path);
+	free(pref->font_bold_path);
+	free(pref->font_italic_path);
+	free(pref->font_bold_italic_path);
 	free(pref->tty_encoding);
+	free(pref->cursor_shape);
 
 	free(pref->text_color);
 	free(pref->background_color);
@@ -376,6 +403,9 @@ void destroy_preferences(pref_t *pref) {
 	
 	free(pref->keyhold_actions_exempt);
 
+	for (char **s = pref->fallback_fonts; *s != NULL; ++s) { free(*s); }
+	free(pref->fallback_fonts);
+
 	free(pref);
 }
 
@@ -415,6 +445,12 @@ pref_t *read_preferences(const char* filename) {
 	DEFAULT_LOOKUP(string, config, "font_path", prefs->font_path, DEFAULT_FONT_PATH);
 	prefs->font_path = strdup(prefs->font_path);
 	DEFAULT_LOOKUP(int, config, "font_size", prefs->font_size, DEFAULT_FONT_SIZE);
+	DEFAULT_LOOKUP(string, config, "font_bold_path", prefs->font_bold_path, DEFAULT_FONT_BOLD_PATH);
+	prefs->font_bold_path = strdup(prefs->font_bold_path);
+	DEFAULT_LOOKUP(string, config, "font_italic_path", prefs->font_italic_path, DEFAULT_FONT_ITALIC_PATH);
+	prefs->font_italic_path = strdup(prefs->font_italic_path);
+	DEFAULT_LOOKUP(string, config, "font_bold_italic_path", prefs->font_bold_italic_path, DEFAULT_FONT_BOLD_ITALIC_PATH);
+	prefs->font_bold_italic_path = strdup(prefs->font_bold_italic_path);
 	prefs->text_color = create_int_array(config, "text_color", PREFS_COLOR_NUM_ELEMENTS, DEFAULT_TEXT_COLOR, 0);
 	prefs->background_color = create_int_array(config, "background_color", PREFS_COLOR_NUM_ELEMENTS, DEFAULT_BACKGROUND_COLOR, 0);
 	DEFAULT_LOOKUP(bool, config, "screen_idle_awake", prefs->screen_idle_awake, DEFAULT_SCREEN_IDLE_AWAKE);
@@ -436,6 +472,16 @@ pref_t *read_preferences(const char* filename) {
 	prefs->keyhold_actions_exempt = create_int_array(config, "keyhold_actions_exempt", DEFAULT_KEYHOLD_ACTIONS_EXEMPT_LEN, DEFAULT_KEYHOLD_ACTIONS_EXEMPT, 1);
 	DEFAULT_LOOKUP(bool, config, "rescreen_for_symmenu", prefs->rescreen_for_symmenu, DEFAULT_RESCREEN_FOR_SYMMENU);
 	DEFAULT_LOOKUP(bool, config, "keyhold_accents", prefs->keyhold_accents, DEFAULT_KEYHOLD_ACCENTS);
+	DEFAULT_LOOKUP(int, config, "row_cache_size", prefs->row_cache_size, DEFAULT_ROW_CACHE_SIZE);
+	DEFAULT_LOOKUP(int, config, "color_cache_size", prefs->color_cache_size, DEFAULT_COLOR_CACHE_SIZE);
+	DEFAULT_LOOKUP(int, config, "render_threads", prefs->render_threads, DEFAULT_RENDER_THREADS);
+	DEFAULT_LOOKUP(bool, config, "glyph_cache", prefs->glyph_cache, DEFAULT_GLYPH_CACHE);
+	DEFAULT_LOOKUP(int, config, "frame_rate", prefs->frame_rate, DEFAULT_FRAME_RATE);
+	DEFAULT_LOOKUP(int, config, "battery_frame_rate", prefs->battery_frame_rate, DEFAULT_BATTERY_FRAME_RATE);
+	prefs->fallback_fonts = create_string_array(config, "fallback_fonts", DEFAULT_FALLBACK_FONTS_LEN, DEFAULT_FALLBACK_FONTS);
+	DEFAULT_LOOKUP(string, config, "cursor_shape", prefs->cursor_shape, DEFAULT_CURSOR_SHAPE);
+	prefs->cursor_shape = strdup(prefs->cursor_shape);
+	DEFAULT_LOOKUP(bool, config, "cursor_blink", prefs->cursor_blink, DEFAULT_CURSOR_BLINK);
 
 	prefs->main_symmenu = create_symmenu(config, "main_symmenu", DEFAULT_SYMMENU_NUM_ROWS, DEFAULT_SYMMENU_ROW_LENS, DEFAULT_SYMMENU_ENTRIES);
 	prefs->altsym_entries = create_keymap_array(config, "altsym_entries", DEFAULT_ALTSYM_ENTRIES_LEN, DEFAULT_ALTSYM_ENTRIES);
@@ -472,6 +518,14 @@ void set_int_array(config_setting_t *root, char const *key, size_t num_elems, in
 	}
 }
 
+void set_string_array(config_setting_t *root, char const *key, char * const *source) {
+	config_setting_t *setting = config_setting_add(root, key, CONFIG_TYPE_ARRAY);
+	for (; *source != NULL; ++source) {
+		config_setting_t *elem = config_setting_add(setting, NULL, CONFIG_TYPE_STRING);
+		config_setting_set_string(elem, *source);
+	}
+}
+
 void set_keymap_array(config_setting_t *root, char const *key, keymap_t const *source) {
 	config_setting_t *setting = config_setting_add(root, key, CONFIG_TYPE_LIST);
 	for (; source->to != NULL; ++source) {
@@ -526,6 +580,9 @@ void save_preferences(pref_t const* prefs, char const* filename) {
 
 	PREF_SET(root, setting, "font_path", string, STRING, prefs->font_path);
 	PREF_SET(root, setting, "font_size", int, INT, prefs->font_size);
+	PREF_SET(root, setting, "font_bold_path", string, STRING, prefs->font_bold_path);
+	PREF_SET(root, setting, "font_italic_path", string, STRING, prefs->font_italic_path);
+	PREF_SET(root, setting, "font_bold_italic_path", string, STRING, prefs->font_bold_italic_path);
 	set_int_array(root, "text_color", PREFS_COLOR_NUM_ELEMENTS, prefs->text_color);
 	set_int_array(root, "background_color", PREFS_COLOR_NUM_ELEMENTS, prefs->background_color);
 	PREF_SET(root, setting, "screen_idle_awake", bool, BOOL, prefs->screen_idle_awake);
@@ -545,6 +602,15 @@ void save_preferences(pref_t const* prefs, char const* filename) {
 	PREF_SET(root, setting, "sticky_shift_key", bool, BOOL, prefs->sticky_shift_key);
 	PREF_SET(root, setting, "sticky_alt_key", bool, BOOL, prefs->sticky_alt_key);
 	PREF_SET(root, setting, "rescreen_for_symmenu", bool, BOOL, prefs->rescreen_for_symmenu);
+	PREF_SET(root, setting, "row_cache_size", int, INT, prefs->row_cache_size);
+	PREF_SET(root, setting, "color_cache_size", int, INT, prefs->color_cache_size);
+	PREF_SET(root, setting, "render_threads", int, INT, prefs->render_threads);
+	PREF_SET(root, setting, "glyph_cache", bool, BOOL, prefs->glyph_cache);
+	PREF_SET(root, setting, "frame_rate", int, INT, prefs->frame_rate);
+	PREF_SET(root, setting, "battery_frame_rate", int, INT, prefs->battery_frame_rate);
+	set_string_array(root, "fallback_fonts", prefs->fallback_fonts);
+	PREF_SET(root, setting, "cursor_shape", string, STRING, prefs->cursor_shape);
+	PREF_SET(root, setting, "cursor_blink", bool, BOOL, prefs->cursor_blink);
 	
 	int num_exempt = 0;
 	for (; prefs->keyhold_actions_exempt[num_exempt] > 0; ++num_exempt) { }
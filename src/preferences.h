@@ -40,6 +40,9 @@ static int PREFS_VERSION = 9;
 
 #define DEFAULT_FONT_PATH "/usr/fonts/font_repository/monotype/cour.ttf"
 #define DEFAULT_FONT_SIZE 24//40
+#define DEFAULT_FONT_BOLD_PATH ""
+#define DEFAULT_FONT_ITALIC_PATH ""
+#define DEFAULT_FONT_BOLD_ITALIC_PATH ""
 #define DEFAULT_TEXT_COLOR (int[]){255, 255, 255}
 #define DEFAULT_BACKGROUND_COLOR (int[]){0, 0, 0}
 #define DEFAULT_SCREEN_IDLE_AWAKE 0
@@ -76,6 +79,16 @@ static int PREFS_VERSION = 9;
 #define DEFAULT_KEYHOLD_ACTIONS_EXEMPT (int[]){KEYCODE_BACKSPACE, KEYCODE_RETURN}
 #define DEFAULT_RESCREEN_FOR_SYMMENU 1
 #define DEFAULT_KEYHOLD_ACCENTS 1
+#define DEFAULT_ROW_CACHE_SIZE 2048
+#define DEFAULT_COLOR_CACHE_SIZE 1024
+#define DEFAULT_RENDER_THREADS 0
+#define DEFAULT_GLYPH_CACHE 1
+#define DEFAULT_FRAME_RATE 60
+#define DEFAULT_BATTERY_FRAME_RATE 30
+#define DEFAULT_FALLBACK_FONTS_LEN 0
+#define DEFAULT_FALLBACK_FONTS (char const*[]){NULL}
+#define DEFAULT_CURSOR_SHAPE "block"
+#define DEFAULT_CURSOR_BLINK 0
 
 #define DEFAULT_ALTSYM_ENTRIES_LEN 27
 #define DEFAULT_ALTSYM_ENTRIES (keymap_t[]) {  \
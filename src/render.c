@@ -0,0 +1,2295 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unicode/utf.h>
+
+#include "SDL.h"
+#include "SDL_ttf.h"
+#include "SDL_thread.h"
+
+#include "types.h"
+#include "terminal.h"
+#include "preferences.h"
+#include "buffer.h"
+#include "palette.h"
+#include "atlas.h"
+#include "rowcache.h"
+#include "colorcache.h"
+#include "boxdraw.h"
+#include "blit.h"
+#include "renderpool.h"
+#include "glyphcache.h"
+#include "charset.h"
+#include "render.h"
+
+static int cursor_x = 0;
+static int cursor_y = 0;
+char draw_cursor = 1;
+/* blinking cursor, from the cursor_blink preference at startup and
+ * DECSET 12 from then on; font changes leave it alone */
+char cursor_blink = 0;
+
+/* set by BEL, shows the bell indicator */
+char flash = 0;
+
+static SDL_Color metamode_cursor_fg = SDL_BLACK;
+static SDL_Color metamode_cursor_bg = SDL_GREEN;
+static SDL_Surface* metamode_cursor;
+
+static TTF_Font* font;
+static const char* loaded_font_path;
+static int loaded_font_size;
+
+/* One font per bold/italic combination, opened when first needed, so
+ * switching style never makes SDL_ttf flush its glyph cache. Entry 0 is
+ * the regular font, and the index is the style's TTF_STYLE_BOLD and
+ * TTF_STYLE_ITALIC bits. The _2x set is the double size font used for
+ * DECDWL/DECDHL lines. */
+#define NUM_FONT_FACES 4
+/* After the faces each set has the fallback fonts from prefs, in order,
+ * for characters the main font doesn't have. These are single faces
+ * that SDL_ttf emboldens and slants itself, so each is opened once per
+ * bold/italic combination as well, indexed the same way. */
+#define MAX_FALLBACK_FONTS 4
+#define FONT_SET_SIZE (NUM_FONT_FACES * (1 + MAX_FALLBACK_FONTS))
+/* glyphs SDL_ttf keeps rendered for each font */
+#define FONT_GLYPH_CACHE_SIZE 512
+static TTF_Font* style_fonts[FONT_SET_SIZE];
+static TTF_Font* style_fonts_2x[FONT_SET_SIZE];
+/* The fonts for render pool workers 1 and up, which draw glyphs at the
+ * same time as worker 0 (the render thread, with style_fonts), and for
+ * the glyph prewarm thread. Each is opened with its own FreeType library. */
+#define PREWARM_WORKER RENDERPOOL_MAX_WORKERS
+static TTF_Font* worker_fonts[RENDERPOOL_MAX_WORKERS + 1][FONT_SET_SIZE];
+/* The characters in the main font and each fallback font, so picking the
+ * font for a character is a bit test. Built once per font file. */
+static struct charset* font_charset = NULL;
+static const char* font_charset_path = NULL;
+static const char* fallback_paths[MAX_FALLBACK_FONTS]; /* the fallback_fonts that aren't empty */
+static struct charset* fallback_charsets[MAX_FALLBACK_FONTS];
+static char fallback_color[MAX_FALLBACK_FONTS]; /* has colour bitmaps (emoji) */
+static int num_fallback_fonts = -1; /* -1 until the fallbacks are read */
+int text_width;
+int text_height;
+static int text_height_padding;
+static int advance;
+/* Underline and strikethrough are drawn over the cells as fills, so the
+ * glyph masks are the same with or without them */
+#define CELL_LINES (TTF_STYLE_UNDERLINE | TTF_STYLE_STRIKETHROUGH)
+static int underline_row;
+static int strikethrough_row;
+static int line_height;
+static int default_text_color_arr[PREFS_COLOR_NUM_ELEMENTS];
+static int default_bg_color_arr[PREFS_COLOR_NUM_ELEMENTS];
+static SDL_Color default_text_color = SDL_WHITE;
+static SDL_Color default_bg_color = SDL_BLACK;
+struct font_style default_text_style;
+
+struct screenchar blank_sc;
+
+/* Glyphs for double width and double height lines, rendered from a font
+ * at twice the size. They are kept here rather than in the glyph atlas,
+ * which only holds normal size masks. */
+#define SCALED_CACHE_SIZE 128
+struct scaled_glyph {
+	UChar32 c;
+	int style;
+	char size;
+	char wide;
+	Uint8* mask;
+};
+static struct scaled_glyph scaled_cache[SCALED_CACHE_SIZE];
+static void scaled_cache_flush();
+
+/* The screen as render_snapshot() found it, for render_frame() to draw.
+ * Taking it is quick and done under the input lock. Drawing it and putting
+ * it on the display happen after the lock is let go, so keystrokes and pty
+ * output never wait for a frame. Only rows with something to draw are
+ * copied, along with their combining marks, since the parser reuses both. */
+struct frame {
+	char full;
+	char invert;
+	char blink_off; /* blinking text is hidden */
+	/* rows of pixels to move for scrolling, scroll_rows 0 for none */
+	int scroll_dst;
+	int scroll_src;
+	int scroll_rows;
+	/* each row's copy of its line, NULL past the end of the buffer */
+	struct screenchar** lines;
+	char cursor;
+	struct screenchar cursor_sc;
+	char cursor_size;
+	int cursor_w;
+	int indicators; /* the indicators to draw */
+	symmenu_t* symmenu;
+	char palette; /* the palette changed */
+};
+static struct frame frame;
+/* the palette as of the last snapshot, and its colours as screen pixels */
+static SDL_Color frame_palette[PALETTE_SIZE];
+static Uint32 frame_pixels[PALETTE_SIZE];
+static unsigned int drawn_palette;
+static char palette_stale = 1;
+static const SDL_Color palette_fg = PALETTE_REF_FG;
+static const SDL_Color palette_bg = PALETTE_REF_BG;
+static Uint8* frame_store;
+static size_t frame_line_bytes;
+static UChar32 (*frame_marks)[COMBINING_MAX];
+static int num_frame_marks;
+static int max_frame_marks;
+
+/* After a font loads, the glyphs the next screens are likely to need are
+ * rasterized on a low priority thread, into masks of its own. render()
+ * moves the finished ones into the glyph atlas, so the atlas is only
+ * ever touched by the render thread. */
+#define PREWARM_SCREEN_GLYPHS 128
+#define PREWARM_PRIORITY_DROP 2
+static SDL_Thread* prewarm_thread = NULL;
+static SDL_mutex* prewarm_mutex = NULL;
+static struct screenchar* prewarm_chars = NULL;
+static Uint8* prewarm_masks = NULL;
+static int prewarm_total = 0;
+static int prewarm_done = 0;    /* rasterized so far, under prewarm_mutex */
+static char prewarm_cancel = 0; /* under prewarm_mutex */
+static int prewarm_taken = 0;   /* moved into the atlas */
+static void prewarm_start();
+static void prewarm_stop();
+
+/* the fonts the atlas masks are drawn with, for the glyph cache file,
+ * and whether any have been drawn since it was loaded */
+static Uint32 glyph_font_id;
+static char glyphs_drawn = 0;
+
+/* The atlases of the last few font sizes, put aside by font_keep() so
+ * that going back to a size, as rotating back or DECCOLM does, starts
+ * with its glyphs. The fonts keep their glyphs at these sizes too, see
+ * TTF_SetFontSize(). */
+struct kept_atlas {
+	int font_size; /* 0 if the entry is empty */
+	struct atlas_state* atlas;
+	Uint32 glyph_font_id;
+	char glyphs_drawn;
+	Uint32 last_used;
+};
+static struct kept_atlas kept_atlases[TTF_KEPT_SIZES];
+static Uint32 kept_clock = 0;
+
+SDL_Surface* screen;
+static SDL_Surface* ctrl_key_indicator;
+static SDL_Surface* alt_key_indicator;
+static SDL_Surface* shift_key_indicator;
+static SDL_Surface* altsym_indicator;
+static SDL_Surface* bell_indicator;
+
+/* values of cursor_shape, from the cursor_shape preference */
+#define CURSOR_BLOCK 0
+#define CURSOR_UNDERLINE 1
+#define CURSOR_BAR 2
+static int cursor_shape = CURSOR_BLOCK;
+
+/* drawing into a surface in memory rather than a window, as the
+ * renderer benchmark does, so there is nothing to flip */
+char headless = 0;
+
+/* from buffer.c */
+extern int rows;
+extern int cols;
+extern buf_t* buf;
+extern int MAX_COLS;
+extern int MAX_ROWS;
+extern int TEXT_BUFFER_SIZE;
+extern struct scroll_region sr;
+extern char full_damage;
+extern struct scroll_damage scroll_damage;
+
+/* from main.c */
+extern pref_t *prefs;
+extern symmenu_t *current_symmenu;
+extern char altsym_lock;
+extern char metamode;
+extern int vmodifiers;
+
+/* The font file configured for a bold or italic face, or NULL
+ * if that face is made by emboldening or slanting the regular font */
+static const char* face_path(int face){
+	const char* path = NULL;
+	switch(face){
+	case TTF_STYLE_BOLD | TTF_STYLE_ITALIC:
+		path = prefs->font_bold_italic_path;
+		break;
+	case TTF_STYLE_BOLD:
+		path = prefs->font_bold_path;
+		break;
+	case TTF_STYLE_ITALIC:
+		path = prefs->font_italic_path;
+		break;
+	default:
+		break;
+	}
+	return (path != NULL && path[0] != '\0') ? path : NULL;
+}
+
+/* Returns the font from set to draw style with, opening it at size if
+ * its face hasn't been used yet. Fonts for a set used on another thread
+ * are opened with their own FreeType library. */
+static TTF_Font* style_font(TTF_Font** set, int size, int style, char private_library){
+	int face = style & (TTF_STYLE_BOLD | TTF_STYLE_ITALIC);
+	TTF_Font* f = set[face];
+	if(f == NULL){
+		const char* path = face_path(face);
+		if(path == NULL && face == (TTF_STYLE_BOLD | TTF_STYLE_ITALIC)){
+			/* slant the bold face, or embolden the italic one */
+			path = face_path(TTF_STYLE_BOLD);
+			if(path == NULL){
+				path = face_path(TTF_STYLE_ITALIC);
+			}
+		}
+		if(path != NULL){
+			f = private_library ? TTF_OpenFontPrivate(path, size) : TTF_OpenFont(path, size);
+			if(f == NULL){
+				fprintf(stderr, "Couldn't load %d pt font from %s: %s\n", size, path, TTF_GetError());
+			}
+		}
+		if(f == NULL){
+			f = private_library ? TTF_OpenFontPrivate(loaded_font_path, size) : TTF_OpenFont(loaded_font_path, size);
+			if(f == NULL){
+				PRINT(stderr, "Couldn't load %d pt font from %s: %s\n", size, loaded_font_path, TTF_GetError());
+				return NULL;
+			}
+		}
+		TTF_SetFontOutline(f, 0);
+		TTF_SetFontKerning(f, 0);
+		TTF_SetFontHinting(f, TTF_HINTING_NORMAL);
+		TTF_SetFontCacheSize(f, FONT_GLYPH_CACHE_SIZE);
+		set[face] = f;
+	}
+	/* Each font only ever sees its own bold and italic bits, and SDL_ttf
+	 * doesn't embolden or slant a face that is already bold or italic.
+	 * Underline and strikethrough don't touch the glyph cache, so this
+	 * never flushes it. */
+	TTF_SetFontStyle(f, style);
+	return f;
+}
+
+/* Returns fallback font k from set at size for style, opening it if needed */
+static TTF_Font* fallback_font(TTF_Font** set, int size, int k, int style, char private_library){
+	int slot = NUM_FONT_FACES * (1 + k) + (style & (TTF_STYLE_BOLD | TTF_STYLE_ITALIC));
+	TTF_Font* f = set[slot];
+	if(f == NULL){
+		const char* path = fallback_paths[k];
+		f = private_library ? TTF_OpenFontPrivate(path, size) : TTF_OpenFont(path, size);
+		if(f == NULL){
+			PRINT(stderr, "Couldn't load %d pt fallback font from %s: %s\n", size, path, TTF_GetError());
+			return NULL;
+		}
+		TTF_SetFontOutline(f, 0);
+		TTF_SetFontKerning(f, 0);
+		TTF_SetFontHinting(f, TTF_HINTING_NORMAL);
+		TTF_SetFontCacheSize(f, FONT_GLYPH_CACHE_SIZE);
+		set[slot] = f;
+	}
+	TTF_SetFontStyle(f, style);
+	return f;
+}
+
+/* Returns the font from set to draw c in: the one for style if the main
+ * font has c, or else the first fallback font that does. *dy is how far
+ * down to move the glyph to line its baseline up with the main font. */
+static TTF_Font* glyph_font(TTF_Font** set, int size, UChar32 c, int style, char private_library, int* dy){
+	*dy = 0;
+	if(c >= 0x80 && font_charset != NULL && !charset_has(font_charset, c)){
+		for(int k = 0; k < num_fallback_fonts; ++k){
+			if(fallback_charsets[k] == NULL || !charset_has(fallback_charsets[k], c)){
+				continue;
+			}
+			TTF_Font* main_font = style_font(set, size, TTF_STYLE_NORMAL, private_library);
+			TTF_Font* f = fallback_font(set, size, k, style, private_library);
+			if(main_font != NULL && f != NULL){
+				*dy = TTF_FontAscent(main_font) - TTF_FontAscent(f);
+				return f;
+			}
+			break;
+		}
+	}
+	return style_font(set, size, style, private_library);
+}
+
+static void add_to_charset(Uint32 ch, void* data){
+	charset_add((struct charset*)data, (UChar32)ch);
+}
+
+/* The characters in f's character map */
+static struct charset* font_characters(TTF_Font* f){
+	struct charset* set = charset_new();
+	if(set != NULL){
+		TTF_FontCharacters(f, add_to_charset, set);
+	}
+	return set;
+}
+
+/* Read the character maps of the fallback fonts, the first time through.
+ * Empty entries in fallback_fonts are left out. */
+static void fallback_init(int size){
+	if(num_fallback_fonts >= 0){
+		return;
+	}
+	num_fallback_fonts = 0;
+	for(int i = 0; num_fallback_fonts < MAX_FALLBACK_FONTS && prefs->fallback_fonts[i] != NULL; ++i){
+		const char* path = prefs->fallback_fonts[i];
+		if(path[0] == '\0'){
+			continue;
+		}
+		int k = num_fallback_fonts++;
+		fallback_paths[k] = path;
+		TTF_Font* f = TTF_OpenFont(path, size);
+		if(f == NULL){
+			fprintf(stderr, "Couldn't load fallback font %s: %s\n", path, TTF_GetError());
+			fallback_charsets[k] = NULL;
+			fallback_color[k] = 0;
+			continue;
+		}
+		fallback_charsets[k] = font_characters(f);
+		fallback_color[k] = TTF_FontHasColor(f);
+		TTF_CloseFont(f);
+	}
+}
+
+static void close_style_fonts(TTF_Font** set){
+	unsigned long hits, misses, evictions;
+	for(int i = 0; i < FONT_SET_SIZE; ++i){
+		if(set[i] != NULL){
+			TTF_GetFontCacheStats(set[i], &hits, &misses, &evictions);
+			PRINT(stderr, "Font face %d glyph cache: %lu hits, %lu misses, %lu evictions\n", i, hits, misses, evictions);
+			TTF_CloseFont(set[i]);
+			set[i] = NULL;
+		}
+	}
+}
+
+static int checked_font_size(int font_size){
+	if(font_size < MIN_FONT_SIZE){
+		fprintf(stderr, "Refusing to set font size to %d - too small\n",font_size);
+		int default_font_columns = (atoi(getenv("WIDTH")) <= 720) ? 45 : 60;
+		font_size = preferences_guess_best_font_size(prefs, default_font_columns);
+	}
+	return font_size;
+}
+
+/* Set up everything drawn from font at loaded_font_size */
+static int font_setup(){
+	/* Set default options */
+	TTF_SetFontStyle(font, TTF_STYLE_NORMAL);
+	TTF_SetFontOutline(font, 0);
+	TTF_SetFontKerning(font, 0);
+	TTF_SetFontHinting(font, TTF_HINTING_NORMAL);
+	TTF_SetFontCacheSize(font, FONT_GLYPH_CACHE_SIZE);
+	style_fonts[0] = font;
+
+	if(font_charset_path != loaded_font_path){
+		charset_free(font_charset);
+		font_charset = font_characters(font);
+		font_charset_path = loaded_font_path;
+	}
+	fallback_init(loaded_font_size);
+
+	/* get default colour settings from prefs struct*/
+	default_text_color.r = (Uint8)prefs->text_color[0];
+	default_text_color.g = (Uint8)prefs->text_color[1];
+	default_text_color.b = (Uint8)prefs->text_color[2];
+	default_text_color.unused = 0;
+	
+	default_bg_color.r = (Uint8)prefs->background_color[0];
+	default_bg_color.g = (Uint8)prefs->background_color[1];
+	default_bg_color.b = (Uint8)prefs->background_color[2];
+	default_bg_color.unused = 0;
+
+	/* cells refer to the default colours, so a new theme applies to what is on screen */
+	palette_init(default_text_color, default_bg_color);
+	default_text_style.fg_color = palette_fg;
+	default_text_style.bg_color = palette_bg;
+	default_text_style.style = TTF_STYLE_NORMAL;
+	default_text_style.reverse = 0;
+	default_text_style.blink = 0;
+
+	if(strcmp(prefs->cursor_shape, "underline") == 0){
+		cursor_shape = CURSOR_UNDERLINE;
+	} else if(strcmp(prefs->cursor_shape, "bar") == 0){
+		cursor_shape = CURSOR_BAR;
+	} else {
+		cursor_shape = CURSOR_BLOCK;
+	}
+
+	/* initialize special characters */
+	UChar str[2] = {' ', NULL};
+	blank_sc.c = ' ';
+	blank_sc.style = default_text_style;
+
+	str[0] = 'A';
+	alt_key_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
+	if (alt_key_indicator == NULL){
+		PRINT(stderr, "Couldn't render alt_key_indicator surface: %s\n", TTF_GetError());
+		return TERM_FAILURE;
+	}
+
+	str[0] = 'C';
+	ctrl_key_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
+	if (ctrl_key_indicator == NULL){
+		PRINT(stderr, "Couldn't render ctrl_key_indicator surface: %s\n", TTF_GetError());
+		return TERM_FAILURE;
+	}
+
+	str[0] = 0x2191;
+	shift_key_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
+	if (shift_key_indicator == NULL){
+		PRINT(stderr, "Couldn't render shift_key_indicator surface: %s\n", TTF_GetError());
+		return TERM_FAILURE;
+	}
+
+	str[0] = 'a';
+	altsym_indicator = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
+	if (shift_key_indicator == NULL){
+		PRINT(stderr, "Couldn't render altsym_indicator surface: %s\n", TTF_GetError());
+		return TERM_FAILURE;
+	}
+
+	/* the visual bell, in reverse colours */
+	str[0] = '!';
+	bell_indicator = TTF_RenderUNICODE_Shaded(font, str, default_bg_color, default_text_color);
+	if (bell_indicator == NULL){
+		PRINT(stderr, "Couldn't render bell_indicator surface: %s\n", TTF_GetError());
+		return TERM_FAILURE;
+	}
+
+	str[0] = 'M';
+	metamode_cursor = TTF_RenderUNICODE_Shaded(font, str, metamode_cursor_fg, metamode_cursor_bg);
+	if (metamode_cursor == NULL){
+		PRINT(stderr, "Couldn't render metamode_cursor surface: %s\n", TTF_GetError());
+		return TERM_FAILURE;
+	}
+
+	/* Get the size of the font */
+	int minx, maxx, miny, maxy;
+	if(TTF_GlyphMetrics(font, (Uint16)'X', &minx, &maxx, &miny, &maxy, &advance) != 0){
+		PRINT(stderr, "Could not get Glyph Metrics: %s\n", TTF_GetError());
+		return TERM_FAILURE;
+	}
+
+	text_width = advance;
+	text_height = maxy - miny;
+	text_height_padding = TTF_FontLineSkip(font) - text_height;
+	text_height += text_height_padding;
+	PRINT(stderr, "Character h: %d w:%d (h padding: %d) advance: %d\n", text_height, text_width, text_height_padding, advance);
+	TTF_FontLineRows(font, &underline_row, &strikethrough_row, &line_height);
+
+	rowcache_init(advance, text_height, PB_D_PIXELS / 8, (size_t)prefs->row_cache_size * 1024);
+	colorcache_init(advance, text_height, (size_t)prefs->color_cache_size * 1024);
+
+	struct kept_atlas* kept = NULL;
+	for(int k = 0; k < TTF_KEPT_SIZES; ++k){
+		if(kept_atlases[k].font_size == loaded_font_size){
+			kept = &kept_atlases[k];
+		}
+	}
+	if(kept != NULL){
+		/* back to a size we had: its glyphs are all still there */
+		atlas_attach(kept->atlas);
+		glyph_font_id = kept->glyph_font_id;
+		glyphs_drawn = kept->glyphs_drawn;
+		kept->font_size = 0;
+		kept->atlas = NULL;
+	} else {
+		if(atlas_init(text_width, text_height, ATLAS_DEFAULT_GLYPHS) == TERM_FAILURE){
+			return TERM_FAILURE;
+		}
+
+		/* box drawing and block elements are drawn to fit the cell exactly,
+		 * put them in the atlas now so borders never go through FreeType */
+		struct glyph_key key;
+		memset(&key, 0, sizeof(key));
+		for(key.c = BOXDRAW_FIRST; key.c <= BOXDRAW_LAST; ++key.c){
+			Uint8* mask = atlas_add(&key);
+			if(mask != NULL){
+				boxdraw_render(key.c, mask, atlas_pitch(), advance, text_height);
+			}
+		}
+
+		if(prefs->glyph_cache){
+			const char* paths[FONT_SET_SIZE] = {loaded_font_path, prefs->font_bold_path,
+			                                    prefs->font_italic_path, prefs->font_bold_italic_path};
+			for(int k = 0; k < num_fallback_fonts; ++k){
+				paths[NUM_FONT_FACES + k] = fallback_paths[k];
+			}
+			glyph_font_id = glyphcache_font_id(paths, NUM_FONT_FACES + num_fallback_fonts, loaded_font_size, TTF_HINTING_NORMAL);
+			glyphcache_load(GLYPHCACHE_FILE_PATH, glyph_font_id, atlas_pitch(), text_height);
+		}
+		glyphs_drawn = 0;
+	}
+
+	prewarm_start();
+
+	/* everything on the screen has to be drawn with the new font */
+	full_damage = 1;
+
+	return TERM_SUCCESS;
+}
+
+int font_init(int font_size){
+	font_size = checked_font_size(font_size);
+
+	/* Load the font */
+	font = TTF_OpenFont(prefs->font_path, font_size);
+	loaded_font_path = prefs->font_path;
+	loaded_font_size = font_size;
+	if ( font == NULL ) {
+		/* try opening the default stuff */
+		fprintf(stderr, "Couldn't load %d pt font from %s: %s\n", font_size, prefs->font_path, SDL_GetError());
+		font = TTF_OpenFont(DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
+		loaded_font_path = DEFAULT_FONT_PATH;
+		loaded_font_size = DEFAULT_FONT_SIZE;
+		if(font == NULL){
+			fprintf(stderr, "Could not open default font %s: %s\n", DEFAULT_FONT_PATH, SDL_GetError());
+			return TERM_FAILURE;
+		}
+	}
+	PRINT(stderr, "Font is Fixed Width: %d\n", TTF_FontFaceIsFixedWidth(font));
+
+	return font_setup();
+}
+
+/* Free the surfaces and rows drawn from the font */
+static void font_free_drawn(){
+	SDL_FreeSurface(metamode_cursor);
+	SDL_FreeSurface(ctrl_key_indicator);
+	SDL_FreeSurface(alt_key_indicator);
+	SDL_FreeSurface(shift_key_indicator);
+	SDL_FreeSurface(bell_indicator);
+	metamode_cursor = NULL;
+	ctrl_key_indicator = NULL;
+	alt_key_indicator = NULL;
+	shift_key_indicator = NULL;
+	bell_indicator = NULL;
+	rowcache_uninit();
+	colorcache_uninit();
+	scaled_cache_flush();
+}
+
+/* Throw away everything drawn from the fonts, but leave them open */
+static void font_teardown(){
+	prewarm_stop();
+	if(prefs->glyph_cache && glyphs_drawn){
+		glyphcache_save(GLYPHCACHE_FILE_PATH, glyph_font_id, atlas_pitch(), text_height);
+	}
+	glyphs_drawn = 0;
+	font_free_drawn();
+	atlas_uninit();
+}
+
+/* Like font_teardown(), but the atlas is put aside for font_setup() to
+ * pick up if the font is set back to this size. The oldest kept atlas
+ * makes room for it. The glyph cache file is only written by
+ * font_teardown(), so a size change doesn't write it every time. */
+static void font_keep(){
+	struct kept_atlas* kept = NULL;
+	prewarm_stop();
+	for(int k = 0; k < TTF_KEPT_SIZES; ++k){
+		if(kept == NULL || (kept->font_size != 0 &&
+		   (kept_atlases[k].font_size == 0 || kept_atlases[k].last_used < kept->last_used))){
+			kept = &kept_atlases[k];
+		}
+	}
+	if(kept->font_size != 0){
+		atlas_free(kept->atlas);
+	}
+	kept->atlas = atlas_detach();
+	kept->font_size = kept->atlas != NULL ? loaded_font_size : 0;
+	kept->glyph_font_id = glyph_font_id;
+	kept->glyphs_drawn = glyphs_drawn;
+	kept->last_used = ++kept_clock;
+	glyphs_drawn = 0;
+	font_free_drawn();
+}
+
+void font_uninit(){
+
+	font_teardown();
+	for(int k = 0; k < TTF_KEPT_SIZES; ++k){
+		atlas_free(kept_atlases[k].atlas);
+		kept_atlases[k].atlas = NULL;
+		kept_atlases[k].font_size = 0;
+	}
+	/* font is style_fonts[0] */
+	close_style_fonts(style_fonts_2x);
+	close_style_fonts(style_fonts);
+	for(int i = 1; i < RENDERPOOL_MAX_WORKERS; ++i){
+		close_style_fonts(worker_fonts[i]);
+	}
+	font = NULL;
+}
+
+static void resize_style_fonts(TTF_Font** set, int size){
+	for(int i = 0; i < FONT_SET_SIZE; ++i){
+		if(set[i] != NULL && TTF_SetFontSize(set[i], size) < 0){
+			/* it will be opened again when it is needed */
+			TTF_CloseFont(set[i]);
+			set[i] = NULL;
+		}
+	}
+}
+
+/* Change to font_size without closing the fonts: the faces stay loaded
+ * and are only set to the new size. The glyphs drawn at the old size are
+ * kept for a while in case it comes back, and the rest is thrown away.
+ * If the size hasn't changed, the glyphs and rows drawn so far are kept
+ * and only the screen is drawn again. */
+int font_resize(int font_size){
+	font_size = checked_font_size(font_size);
+	if(font != NULL && font_size == loaded_font_size){
+		full_damage = 1;
+		return TERM_SUCCESS;
+	}
+	font_keep();
+	resize_style_fonts(style_fonts, font_size);
+	resize_style_fonts(style_fonts_2x, 2 * font_size);
+	for(int i = 1; i < RENDERPOOL_MAX_WORKERS; ++i){
+		resize_style_fonts(worker_fonts[i], font_size);
+	}
+	if(style_fonts[0] == NULL){
+		font_uninit();
+		return font_init(font_size);
+	}
+	font = style_fonts[0];
+	loaded_font_size = font_size;
+	return font_setup();
+}
+
+SDL_Color adjust_color(SDL_Color in, struct font_style sty){
+	int n = palette_entry(in);
+	if((sty.style & TTF_STYLE_BOLD) && n >= 0 && n < 8){
+		/* bold brightens the first 8 colours */
+		in = palette_ref(n + 8);
+	}
+	return in;
+}
+
+/* The colour c stands for in this frame */
+static SDL_Color color_rgb(SDL_Color c){
+	int n = palette_entry(c);
+	return n >= 0 ? frame_palette[n] : c;
+}
+
+/* c as a screen pixel. Palette colours are mapped once for each palette change. */
+static Uint32 color_pixel(SDL_Color c){
+	int n = palette_entry(c);
+	return n >= 0 ? frame_pixels[n] : SDL_MapRGB(screen->format, c.r, c.g, c.b);
+}
+
+/* Copy src into the frame as dst, moving any combining marks
+ * into the frame's own table */
+static void frame_copy_cell(struct screenchar* dst, struct screenchar* src){
+	*dst = *src;
+	if(src->combining == 0){
+		return;
+	}
+	if(num_frame_marks == max_frame_marks){
+		int n = max_frame_marks ? 2 * max_frame_marks : 64;
+		UChar32 (*marks)[COMBINING_MAX] = realloc(frame_marks, n * sizeof(frame_marks[0]));
+		if(marks == NULL){
+			dst->combining = 0;
+			return;
+		}
+		frame_marks = marks;
+		max_frame_marks = n;
+	}
+	memset(frame_marks[num_frame_marks], 0, sizeof(frame_marks[0]));
+	buf_get_combining(src, frame_marks[num_frame_marks]);
+	dst->combining = ++num_frame_marks;
+}
+
+/* The combining marks of a cell in the frame, as buf_get_combining() */
+static int cell_marks(struct screenchar* sc, UChar32* marks){
+	int n = 0;
+	if(sc->combining){
+		while(n < COMBINING_MAX && frame_marks[sc->combining - 1][n] != 0){
+			marks[n] = frame_marks[sc->combining - 1][n];
+			++n;
+		}
+	}
+	return n;
+}
+
+/* The colours to draw sc with, swapped if invert is set */
+static void cell_colors(struct screenchar* sc, char invert, SDL_Color* fg, SDL_Color* bg){
+	if(invert){
+		*fg = adjust_color(sc->style.bg_color, sc->style);
+		*bg = sc->style.fg_color;
+	} else {
+		*fg = adjust_color(sc->style.fg_color, sc->style);
+		*bg = sc->style.bg_color;
+	}
+}
+
+static int same_color(SDL_Color a, SDL_Color b){
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.unused == b.unused;
+}
+
+/* Whether sc is blinking text in the hidden half of the blink. Only its
+ * background is drawn, lines and all. */
+static int blinked_off(struct screenchar* sc){
+	return sc->style.blink && frame.blink_off;
+}
+
+static void scaled_cache_flush(){
+	for(int i = 0; i < SCALED_CACHE_SIZE; ++i){
+		free(scaled_cache[i].mask);
+		scaled_cache[i].mask = NULL;
+	}
+}
+
+/* OR the pixels of an 8 bit shaded render into a w x h mask, dy rows
+ * down. Rendered white on black the pixel values are the glyph coverage. */
+static void surface_to_mask(SDL_Surface* glyph, Uint8* mask, int pitch, int w, int h, int dy){
+	int copy_w = glyph->w < w ? glyph->w : w;
+	for(int y = 0; y < glyph->h; ++y){
+		if(y + dy < 0 || y + dy >= h){
+			continue;
+		}
+		Uint8* dst = mask + (y + dy) * pitch;
+		Uint8* src = (Uint8*)glyph->pixels + y * glyph->pitch;
+		for(int x = 0; x < copy_w; ++x){
+			dst[x] |= src[x];
+		}
+	}
+}
+
+/* OR c into a w x h mask where the surface of c alone from
+ * TTF_RenderUNICODE_Shaded() would put it, from the font in set that has
+ * it. SDL_ttf doesn't shape, so a string of a character and its marks
+ * would put each mark a whole advance along, mostly out of the cell;
+ * instead every mark is drawn this way over its base, from the same
+ * origin. */
+static void draw_char(TTF_Font** set, int size, UChar32 c, int style, char private_library,
+                      Uint8* mask, int pitch, int w, int h){
+	static const SDL_Color white = SDL_WHITE;
+	static const SDL_Color black = SDL_BLACK;
+	UChar str[3];
+	int len = 0;
+	int dy;
+
+	TTF_Font* f = glyph_font(set, size, c, style, private_library, &dy);
+	if(f == NULL){
+		return;
+	}
+	if(dy >= 0){
+		/* straight into the mask, with no surface or string */
+		if(TTF_RenderGlyph_Cell(f, (Uint32)c, mask + dy * pitch, pitch, w, h - dy) < 0){
+			PRINT(stderr, "Rendering failed for char %d\n", (int)c);
+		}
+		return;
+	}
+	/* shifted up past the top of the mask, so clip a surface */
+	U16_APPEND_UNSAFE(str, len, c);
+	str[len] = 0;
+	SDL_Surface* glyph = TTF_RenderUNICODE_Shaded(f, str, white, black);
+	if(glyph == NULL){
+		PRINT(stderr, "Rendering failed for char %d\n", (int)c);
+		return;
+	}
+	surface_to_mask(glyph, mask, pitch, w, h, dy);
+	SDL_FreeSurface(glyph);
+}
+
+/* Draw sc and its combining marks into a w x h mask with draw_char() */
+static void draw_cell(TTF_Font** set, int size, struct screenchar* sc, int style, char private_library,
+                      Uint8* mask, int pitch, int w, int h){
+	UChar32 marks[COMBINING_MAX];
+	int n = cell_marks(sc, marks);
+	draw_char(set, size, sc->c, style, private_library, mask, pitch, w, h);
+	for(int i = 0; i < n; ++i){
+		draw_char(set, size, marks[i], style, private_library, mask, pitch, w, h);
+	}
+}
+
+/* Box drawing and the like on double size lines are drawn by
+ * boxdraw_render(), unless they have marks or lines on them that only
+ * the font can add */
+static int is_boxdraw(struct screenchar* sc){
+	return !sc->combining && boxdraw_has(sc->c) &&
+	       !(sc->style.style & (TTF_STYLE_UNDERLINE | TTF_STYLE_STRIKETHROUGH));
+}
+
+/* Returns the mask for sc from the glyph atlas. If it isn't there yet a
+ * new mask is returned and *fresh is set, and the caller must fill it in
+ * with rasterize_glyph(). Box drawing is filled in straight away. The
+ * masks leave out underline and strikethrough, see render_lines(). */
+static Uint8* glyph_slot(struct screenchar* sc, char* fresh){
+	struct glyph_key key;
+	Uint8* mask;
+
+	*fresh = 0;
+	memset(&key, 0, sizeof(key));
+	key.c = sc->c;
+	key.style = sc->style.style & ~CELL_LINES;
+	cell_marks(sc, key.marks);
+	mask = atlas_find(&key);
+	if(mask != NULL){
+		return mask;
+	}
+	mask = atlas_add(&key);
+	if(mask != NULL){
+		if(!sc->combining && boxdraw_has(sc->c)){
+			boxdraw_render(sc->c, mask, atlas_pitch(), (sc->wide == SC_WIDE_LEFT ? 2 : 1) * advance, text_height);
+		} else {
+			*fresh = 1;
+			glyphs_drawn = 1;
+		}
+	}
+	return mask;
+}
+
+/* Draw sc into an empty atlas mask with the fonts of a render pool
+ * worker. Workers only ever touch their own fonts and masks. */
+static void rasterize_glyph(struct screenchar* sc, int worker, Uint8* mask){
+	TTF_Font** set = worker == 0 ? style_fonts : worker_fonts[worker];
+	draw_cell(set, loaded_font_size, sc, sc->style.style & ~CELL_LINES, worker != 0,
+	          mask, atlas_pitch(), 2 * advance, text_height);
+}
+
+/* The fallback font to draw sc from in colour, or -1 if it is drawn from
+ * the atlas. Colour glyphs are double width characters the main font
+ * doesn't have, whose first fallback font is a colour one, with no marks
+ * on them but the emoji presentation selector. */
+static int color_font(struct screenchar* sc){
+	UChar32 marks[COMBINING_MAX];
+	int n;
+	if(sc->c < 0x80 || sc->wide != SC_WIDE_LEFT || font_charset == NULL || charset_has(font_charset, sc->c)){
+		return -1;
+	}
+	n = cell_marks(sc, marks);
+	for(int i = 0; i < n; ++i){
+		if(marks[i] != 0xFE0F){
+			return -1;
+		}
+	}
+	for(int k = 0; k < num_fallback_fonts; ++k){
+		if(fallback_charsets[k] != NULL && charset_has(fallback_charsets[k], sc->c)){
+			return fallback_color[k] ? k : -1;
+		}
+	}
+	return -1;
+}
+
+/* Returns the colour pixels for sc from the colour glyph cache, drawing
+ * them first if they aren't there yet, or NULL if sc is drawn from the
+ * atlas. They are scaled to two cells here, once, and blended as they
+ * are from then on. */
+static const Uint32* color_glyph(struct screenchar* sc){
+	char found;
+	int k = color_font(sc);
+	if(k < 0){
+		return NULL;
+	}
+	const Uint32* pixels = colorcache_find(sc->c, &found);
+	if(found){
+		return pixels;
+	}
+	Uint32* fresh = colorcache_add(sc->c);
+	if(fresh == NULL){
+		return NULL;
+	}
+	TTF_Font* f = fallback_font(style_fonts, loaded_font_size, k, TTF_STYLE_NORMAL, 0);
+	if(f == NULL || TTF_RenderGlyph_Color(f, (Uint32)sc->c, fresh, colorcache_pitch(), 2 * advance, text_height) < 0){
+		PRINT(stderr, "No colour glyph for char %d: %s\n", (int)sc->c, TTF_GetError());
+		colorcache_no_color(sc->c);
+		return NULL;
+	}
+	return fresh;
+}
+
+/* Returns the coverage mask for sc from the glyph atlas,
+ * rasterizing it first if it isn't there yet. */
+static const Uint8* glyph_mask(struct screenchar* sc){
+	char fresh;
+	Uint8* mask = glyph_slot(sc, &fresh);
+	if(fresh){
+		rasterize_glyph(sc, 0, mask);
+	}
+	return mask;
+}
+
+static int prewarm_run(void* data){
+	struct sched_param param;
+	int policy;
+	size_t mask_size = (size_t)atlas_pitch() * text_height;
+
+	/* stay out of the way of the render and input threads */
+	if(pthread_getschedparam(pthread_self(), &policy, &param) == 0){
+		param.sched_priority -= PREWARM_PRIORITY_DROP;
+		if(param.sched_priority < sched_get_priority_min(policy)){
+			param.sched_priority = sched_get_priority_min(policy);
+		}
+		pthread_setschedparam(pthread_self(), policy, &param);
+	}
+
+	for(int k = 0; k < prewarm_total; ++k){
+		SDL_mutexP(prewarm_mutex);
+		char cancel = prewarm_cancel;
+		SDL_mutexV(prewarm_mutex);
+		if(cancel){
+			break;
+		}
+		rasterize_glyph(&prewarm_chars[k], PREWARM_WORKER, prewarm_masks + k * mask_size);
+		SDL_mutexP(prewarm_mutex);
+		prewarm_done = k + 1;
+		SDL_mutexV(prewarm_mutex);
+	}
+	return 0;
+}
+
+static int prewarm_queued(UChar32 c, int style){
+	for(int k = 0; k < prewarm_total; ++k){
+		if(prewarm_chars[k].c == c && prewarm_chars[k].style.style == style){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Queue a glyph, unless the glyph cache file has put it in the atlas already */
+static void prewarm_queue(UChar32 c, int style){
+	struct glyph_key key;
+	memset(&key, 0, sizeof(key));
+	key.c = c;
+	key.style = style;
+	if(atlas_find(&key) != NULL){
+		return;
+	}
+	struct screenchar* sc = &prewarm_chars[prewarm_total++];
+	*sc = blank_sc;
+	sc->c = c;
+	sc->style.style = style;
+}
+
+struct glyph_use {
+	UChar32 c;
+	int style;
+	int count;
+};
+
+static int more_used(const void* a, const void* b){
+	return ((const struct glyph_use*)b)->count - ((const struct glyph_use*)a)->count;
+}
+
+/* Queue the glyphs used most on the screen that aren't queued already */
+static void prewarm_queue_screen(){
+	struct glyph_use used[2 * PREWARM_SCREEN_GLYPHS];
+	int num_used = 0;
+
+	if(buf == NULL){
+		return;
+	}
+	for(int i = 0; i < rows && i + buf->top_line < TEXT_BUFFER_SIZE; ++i){
+		struct screenchar* line = buf->text[i + buf->top_line];
+		for(int j = 0; j < cols; ++j){
+			struct screenchar* sc = &line[j];
+			int style = sc->style.style & ~CELL_LINES;
+			int k;
+			if(sc->c == 0 || sc->c == ' ' || sc->combining || boxdraw_has(sc->c) ||
+			   color_font(sc) >= 0 || prewarm_queued(sc->c, style)){
+				continue;
+			}
+			for(k = 0; k < num_used; ++k){
+				if(used[k].c == sc->c && used[k].style == style){
+					break;
+				}
+			}
+			if(k < num_used){
+				++used[k].count;
+			} else if(num_used < 2 * PREWARM_SCREEN_GLYPHS){
+				used[num_used].c = sc->c;
+				used[num_used].style = style;
+				used[num_used++].count = 1;
+			}
+		}
+	}
+	qsort(used, num_used, sizeof(used[0]), more_used);
+	for(int k = 0; k < num_used && k < PREWARM_SCREEN_GLYPHS; ++k){
+		prewarm_queue(used[k].c, used[k].style);
+	}
+}
+
+/* Start rasterizing printable ASCII in the normal and bold styles, and
+ * the glyphs used most on the screen, in the background. Box drawing is
+ * already in the atlas. */
+static void prewarm_start(){
+	static const int styles[] = {TTF_STYLE_NORMAL, TTF_STYLE_BOLD};
+	int max_glyphs = 2 * ('~' - '!' + 1) + PREWARM_SCREEN_GLYPHS;
+
+	prewarm_stop();
+	if(prewarm_mutex == NULL){
+		prewarm_mutex = SDL_CreateMutex();
+	}
+	prewarm_chars = (struct screenchar*)calloc(max_glyphs, sizeof(struct screenchar));
+	prewarm_masks = (Uint8*)calloc((size_t)max_glyphs * atlas_pitch(), text_height);
+	if(prewarm_mutex == NULL || prewarm_chars == NULL || prewarm_masks == NULL){
+		prewarm_stop();
+		return;
+	}
+	for(int s = 0; s < sizeof(styles) / sizeof(styles[0]); ++s){
+		for(UChar32 c = '!'; c <= '~'; ++c){
+			prewarm_queue(c, styles[s]);
+		}
+	}
+	prewarm_queue_screen();
+	if(prewarm_total == 0){
+		prewarm_stop();
+		return;
+	}
+
+	prewarm_done = 0;
+	prewarm_taken = 0;
+	prewarm_cancel = 0;
+	prewarm_thread = SDL_CreateThread(prewarm_run, NULL);
+	if(prewarm_thread == NULL){
+		PRINT(stderr, "Couldn't start glyph prewarm thread: %s\n", SDL_GetError());
+		prewarm_stop();
+	}
+}
+
+/* Stop the prewarm thread if it is still running, and free its masks and fonts */
+static void prewarm_stop(){
+	if(prewarm_thread != NULL){
+		SDL_mutexP(prewarm_mutex);
+		prewarm_cancel = 1;
+		SDL_mutexV(prewarm_mutex);
+		SDL_WaitThread(prewarm_thread, NULL);
+		prewarm_thread = NULL;
+	}
+	close_style_fonts(worker_fonts[PREWARM_WORKER]);
+	free(prewarm_chars);
+	free(prewarm_masks);
+	prewarm_chars = NULL;
+	prewarm_masks = NULL;
+	prewarm_total = 0;
+	prewarm_done = 0;
+	prewarm_taken = 0;
+}
+
+/* Move the glyphs the prewarm thread has finished into the atlas, unless
+ * they were drawn there already */
+static void prewarm_publish(){
+	size_t mask_size = (size_t)atlas_pitch() * text_height;
+	struct glyph_key key;
+	int done;
+
+	if(prewarm_thread == NULL){
+		return;
+	}
+	SDL_mutexP(prewarm_mutex);
+	done = prewarm_done;
+	SDL_mutexV(prewarm_mutex);
+	for(; prewarm_taken < done; ++prewarm_taken){
+		memset(&key, 0, sizeof(key));
+		key.c = prewarm_chars[prewarm_taken].c;
+		key.style = prewarm_chars[prewarm_taken].style.style;
+		if(atlas_find(&key) == NULL){
+			Uint8* mask = atlas_add(&key);
+			if(mask != NULL){
+				memcpy(mask, prewarm_masks + prewarm_taken * mask_size, mask_size);
+				glyphs_drawn = 1;
+			}
+		}
+	}
+	if(prewarm_taken == prewarm_total){
+		PRINT(stderr, "Prewarmed %d glyphs\n", prewarm_total);
+		prewarm_stop();
+	}
+}
+
+/* Render sc from the double size font and cut out the part shown on a
+ * line of the given size: the top or bottom half for double height
+ * lines, or the whole glyph squashed to one row for double width lines,
+ * averaging each pair of rows. */
+static Uint8* render_scaled_glyph(struct screenchar* sc, char size){
+	int w = (sc->wide == SC_WIDE_LEFT ? 4 : 2) * advance;
+	int big_h = 2 * text_height;
+	Uint8* big = (Uint8*)calloc(w * big_h, 1);
+	if(big == NULL){
+		return NULL;
+	}
+	if(is_boxdraw(sc)){
+		/* draw it at double size to fit the doubled cell */
+		boxdraw_render(sc->c, big, w, w, big_h);
+	} else {
+		draw_cell(style_fonts_2x, 2 * loaded_font_size, sc, sc->style.style, 0, big, w, w, big_h);
+	}
+	Uint8* mask = (Uint8*)calloc(w * text_height, 1);
+	if(mask != NULL){
+		for(int y = 0; y < text_height; ++y){
+			Uint8* dst = mask + y * w;
+			int src_y = y;
+			if(size == LINE_DOUBLE_BOTTOM){
+				src_y = y + text_height;
+			} else if(size == LINE_DOUBLE_WIDTH){
+				src_y = 2 * y;
+			}
+			Uint8* src = big + src_y * w;
+			if(size == LINE_DOUBLE_WIDTH){
+				Uint8* src2 = src + w;
+				for(int x = 0; x < w; ++x){
+					dst[x] = (src[x] + src2[x] + 1) / 2;
+				}
+			} else {
+				memcpy(dst, src, w);
+			}
+		}
+	}
+	free(big);
+	return mask;
+}
+
+/* Look up the double size mask for sc in the scaled glyph cache, rendering
+ * it if needed. The cache owns the returned mask, which is 2 cells wide
+ * per character cell. */
+static const Uint8* scaled_glyph(struct screenchar* sc, char size){
+	static Uint8* uncached = NULL;
+	if(sc->combining){
+		/* there is no key for these, keep only the last one around */
+		free(uncached);
+		uncached = render_scaled_glyph(sc, size);
+		return uncached;
+	}
+	unsigned int h = (unsigned int)sc->c * 31 + sc->style.style * 7 + size * 3 + sc->wide;
+	struct scaled_glyph* sg = &scaled_cache[h % SCALED_CACHE_SIZE];
+	if(sg->mask != NULL && sg->c == sc->c && sg->style == sc->style.style &&
+	   sg->size == size && sg->wide == sc->wide){
+		return sg->mask;
+	}
+	free(sg->mask);
+	sg->mask = render_scaled_glyph(sc, size);
+	sg->c = sc->c;
+	sg->style = sc->style.style;
+	sg->size = size;
+	sg->wide = sc->wide;
+	return sg->mask;
+}
+
+/* Fill a rectangle of cells with a colour */
+static void fill_cells(int x, int y, int w, SDL_Color color){
+	SDL_Rect r;
+	r.x = x;
+	r.y = y;
+	r.w = w;
+	r.h = text_height;
+	SDL_FillRect(screen, &r, color_pixel(color));
+}
+
+/* Draw a double width or double height line. Only the
+ * first half of the cells fit on the screen. */
+static void render_scaled_line(struct screenchar* line, char size, int y){
+	SDL_Color fg, bg;
+	fill_cells(0, y, cols * advance, frame.invert ? palette_fg : palette_bg);
+	for(int j = 0; j < cols / 2; ++j){
+		struct screenchar* sc = &line[j];
+		if(sc->wide == SC_WIDE_RIGHT && j > 0 && line[j-1].wide == SC_WIDE_LEFT){
+			continue;
+		}
+		int w = (sc->wide == SC_WIDE_LEFT ? 4 : 2) * advance;
+		if(sc->c == 0){
+			continue;
+		}
+		cell_colors(sc, frame.invert, &fg, &bg);
+		const Uint8* mask = blinked_off(sc) ? NULL : scaled_glyph(sc, size);
+		if(mask != NULL){
+			atlas_blit(screen, j * 2 * advance, y, w, text_height, mask, w, color_rgb(fg), color_rgb(bg));
+		} else {
+			fill_cells(j * 2 * advance, y, w, bg);
+		}
+	}
+}
+
+/* Render timers, for what changes with time instead of with output: the
+ * blink of text and of the cursor, and how long the bell shows. The
+ * render loop sleeps until the next one is due, and its tick only flips
+ * some state that render_snapshot() turns into damage to the few cells
+ * that change. Timers run on the render thread. */
+#define TIMER_BLINK 0
+#define TIMER_CURSOR 1
+#define TIMER_BELL 2
+#define NUM_TIMERS 3
+#define BLINK_NSEC 500000000ULL
+#define CURSOR_BLINK_NSEC 500000000ULL
+#define BELL_NSEC 200000000ULL
+static uint64_t timer_due[NUM_TIMERS]; /* 0 when stopped */
+static char blink_off = 0;     /* blinking text is hidden */
+static char blink_ticked = 0;  /* and it changed since the last snapshot */
+static char cursor_off = 0;    /* the blinking cursor is hidden */
+static char bell_on = 0;
+
+uint64_t now_nsec(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void timer_start(int t, uint64_t nsec){
+	timer_due[t] = now_nsec() + nsec;
+}
+
+static void timer_stop(int t){
+	timer_due[t] = 0;
+}
+
+/* Nanoseconds until the next timer is due, TIMER_NONE if none are running */
+uint64_t timer_wait(){
+	uint64_t now_t = now_nsec();
+	uint64_t wait_t = TIMER_NONE;
+	for(int t = 0; t < NUM_TIMERS; ++t){
+		if(timer_due[t] == 0){
+			continue;
+		}
+		uint64_t w = timer_due[t] > now_t ? timer_due[t] - now_t : 0;
+		if(w < wait_t){
+			wait_t = w;
+		}
+	}
+	return wait_t;
+}
+
+/* Tick the timers that are due. Returns whether any did, and so whether
+ * there is a frame to draw. */
+int run_timers(){
+	uint64_t now_t = now_nsec();
+	int ticked = 0;
+	for(int t = 0; t < NUM_TIMERS; ++t){
+		if(timer_due[t] == 0 || timer_due[t] > now_t){
+			continue;
+		}
+		ticked = 1;
+		switch(t){
+			case TIMER_BLINK:
+				blink_off = !blink_off;
+				blink_ticked = 1;
+				timer_start(t, BLINK_NSEC);
+				break;
+			case TIMER_CURSOR:
+				cursor_off = !cursor_off;
+				timer_start(t, CURSOR_BLINK_NSEC);
+				break;
+			default:
+				bell_on = 0;
+				timer_stop(t);
+				break;
+		}
+	}
+	return ticked;
+}
+
+/* Damage tracking. These remember what the screen showed after the last
+ * render(), so the next one only draws the parts that changed: rows whose
+ * line moved (scrolling swaps line pointers), the dirty spans the parser
+ * marked on each line, and the cursor, indicators and symmenu. */
+static struct screenchar** drawn_lines;
+static buf_t* drawn_buf;
+static int drawn_rows;
+static int drawn_cols;
+static char drawn_inverse;
+static symmenu_t* drawn_symmenu;
+static int drawn_indicators;
+static char drawn_cursor;
+static int drawn_cursor_x;
+static int drawn_cursor_y;
+static int drawn_cursor_w;
+/* the columns redrawn on each row by the current render() */
+static int* redrawn_start;
+static int* redrawn_end;
+static SDL_Rect* update_rects;
+static int num_update_rects;
+static int damage_bottom;
+/* drawn_lines entry for a row whose pixels don't show any line */
+static struct screenchar stale_row;
+
+/* the modifier indicators down the right hand side, and the bell */
+#define NUM_INDICATORS 6
+#define INDICATOR_METAMODE 0x01
+#define INDICATOR_CTRL 0x02
+#define INDICATOR_ALT 0x04
+#define INDICATOR_SHIFT 0x08
+#define INDICATOR_ALTSYM 0x10
+#define INDICATOR_BELL 0x20
+static const int indicator_rows[NUM_INDICATORS] = {0, 1, 2, 3, 3, 0};
+
+/* Full repaints split across the render pool. The render thread looks up
+ * every cell's mask first, making room in the atlas for new glyphs, then
+ * the workers rasterize the new glyphs and draw bands of rows at once. */
+struct raster_job {
+	struct screenchar* sc;
+	Uint8* mask;
+};
+/* new glyphs per repaint; past this it is drawn on one thread. The masks
+ * a repaint uses are pinned in the atlas until they are all found, so a
+ * new glyph never takes the slot of one the repaint is still using. */
+#define MAX_RASTER_JOBS (ATLAS_DEFAULT_GLYPHS / 2)
+static struct raster_job* raster_jobs;
+static int num_raster_jobs;
+static const Uint8** cell_masks;
+static const Uint32** cell_color_glyphs;
+static const Uint8** row_pixels;
+static Uint32* row_hashes;
+
+int render_init(){
+	drawn_lines = (struct screenchar**)calloc(MAX_ROWS, sizeof(struct screenchar*));
+	redrawn_start = (int*)calloc(MAX_ROWS, sizeof(int));
+	redrawn_end = (int*)calloc(MAX_ROWS, sizeof(int));
+	/* a rect per row, plus the cursor, indicators and symmenu */
+	update_rects = (SDL_Rect*)calloc(MAX_ROWS + NUM_INDICATORS + 2, sizeof(SDL_Rect));
+	/* frame lines are laid out like buffer lines, header first */
+	frame_line_bytes = sizeof(union line_header) + (MAX_COLS+1) * sizeof(struct screenchar);
+	frame.lines = (struct screenchar**)calloc(MAX_ROWS, sizeof(struct screenchar*));
+	frame_store = (Uint8*)calloc(MAX_ROWS, frame_line_bytes);
+	if(drawn_lines == NULL || redrawn_start == NULL || redrawn_end == NULL || update_rects == NULL ||
+	   frame.lines == NULL || frame_store == NULL){
+		return TERM_FAILURE;
+	}
+	/* the screen format may have changed */
+	palette_stale = 1;
+
+	int threads = prefs->render_threads;
+	if(threads <= 0){
+		threads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		threads = threads < 1 ? 1 : threads > 4 ? 4 : threads;
+#endif
+	}
+	if(threads > 1){
+		raster_jobs = (struct raster_job*)calloc(MAX_RASTER_JOBS, sizeof(struct raster_job));
+		cell_masks = (const Uint8**)calloc((size_t)MAX_ROWS * MAX_COLS, sizeof(Uint8*));
+		cell_color_glyphs = (const Uint32**)calloc((size_t)MAX_ROWS * MAX_COLS, sizeof(Uint32*));
+		row_pixels = (const Uint8**)calloc(MAX_ROWS, sizeof(Uint8*));
+		row_hashes = (Uint32*)calloc(MAX_ROWS, sizeof(Uint32));
+		if(raster_jobs == NULL || cell_masks == NULL || cell_color_glyphs == NULL ||
+		   row_pixels == NULL || row_hashes == NULL ||
+		   renderpool_init(threads) == TERM_FAILURE){
+			fprintf(stderr, "Couldn't start render pool, drawing on one thread\n");
+			renderpool_uninit();
+		}
+	}
+	full_damage = 1;
+	return TERM_SUCCESS;
+}
+
+void render_uninit(){
+	renderpool_uninit();
+	free(drawn_lines);
+	free(redrawn_start);
+	free(redrawn_end);
+	free(update_rects);
+	free(frame.lines);
+	free(frame_store);
+	free(frame_marks);
+	frame_marks = NULL;
+	max_frame_marks = 0;
+	free(raster_jobs);
+	free(cell_masks);
+	free(cell_color_glyphs);
+	free(row_pixels);
+	free(row_hashes);
+}
+
+/* The line showing on screen row i, or NULL past the end of the buffer */
+static struct screenchar* screen_line(int i){
+	/* guard against screen rotations that push the bottom of the screen past the
+	 * bottom of the buffer. */
+	return i+buf->top_line < TEXT_BUFFER_SIZE ? buf->text[i+buf->top_line] : NULL;
+}
+
+static void add_update_rect(int x, int y, int w, int h){
+	if(x + w > screen->w){ w = screen->w - x; }
+	if(y + h > screen->h){ h = screen->h - y; }
+	if(w <= 0 || h <= 0){
+		return;
+	}
+	if(y + h > damage_bottom){
+		damage_bottom = y + h;
+	}
+	if(num_update_rects > 0){
+		/* merge runs of rows with the same span */
+		SDL_Rect* prev = &update_rects[num_update_rects - 1];
+		if(prev->x == x && prev->w == w && prev->y + prev->h == y){
+			prev->h += h;
+			return;
+		}
+	}
+	update_rects[num_update_rects].x = x;
+	update_rects[num_update_rects].y = y;
+	update_rects[num_update_rects].w = w;
+	update_rects[num_update_rects].h = h;
+	++num_update_rects;
+}
+
+/* Ask for cells on screen row to be drawn again on the next render */
+static void damage_cells(int row, int col, int n){
+	if(row < 0 || row >= rows){
+		return;
+	}
+	struct screenchar* line = screen_line(row);
+	if(line == NULL){
+		full_damage = 1;
+	} else if(line == drawn_lines[row]){
+		buf_mark_dirty(line, col, n);
+	}
+	/* otherwise the whole row is drawn again anyway */
+}
+
+/* Ask for the blinking cells on screen to be drawn again, for a change
+ * of blink phase. Returns whether there were any. */
+static int damage_blinking(){
+	int found = 0;
+	for(int i = 0; i < rows; ++i){
+		struct screenchar* line = screen_line(i);
+		if(line == NULL){
+			continue;
+		}
+		for(int j = 0; j < cols; ++j){
+			if(line[j].c == 0 || !line[j].style.blink){
+				continue;
+			}
+			int start = j;
+			while(j < cols && line[j].style.blink){
+				++j;
+			}
+			damage_cells(i, start, j - start);
+			found = 1;
+		}
+	}
+	return found;
+}
+
+/* Plan moving the pixels of rows that scrolled since the last render, so
+ * that only the rows scrolled into view have to be drawn. What was drawn
+ * is moved along with the pixels, and the row loop in render_snapshot()
+ * takes care of anything that doesn't match the buffer. */
+static void scroll_drawn_rows(){
+	struct scroll_damage sd = scroll_damage;
+	int top = sd.top < 0 ? 0 : sd.top;
+	int bottom = sd.bottom > rows ? rows : sd.bottom;
+	int n = sd.amount;
+	int band = bottom - top - abs(n);
+	int i, k, matched = 0;
+
+	if(sd.mixed || n == 0 || band <= 0 || current_symmenu != NULL){
+		return;
+	}
+	/* only worth it if the lines really did move the way it says */
+	for(i = top; i < bottom; ++i){
+		int from = i + n;
+		if(from >= top && from < bottom && drawn_lines[from] == screen_line(i) && drawn_lines[from] != NULL){
+			++matched;
+		}
+	}
+	if(2 * matched <= band){
+		return;
+	}
+
+	int dst_row = n > 0 ? top : top - n;
+	int src_row = n > 0 ? top + n : top;
+	frame.scroll_dst = dst_row;
+	frame.scroll_src = src_row;
+	frame.scroll_rows = band;
+
+	memmove(&drawn_lines[dst_row], &drawn_lines[src_row], band * sizeof(struct screenchar*));
+	for(i = n > 0 ? bottom - n : top; i < (n > 0 ? bottom : top - n); ++i){
+		drawn_lines[i] = &stale_row;
+	}
+
+	/* the old cursor moved too, or went with the rows that scrolled away */
+	if(drawn_cursor && drawn_cursor_y >= top && drawn_cursor_y < bottom){
+		drawn_cursor_y -= n;
+		if(drawn_cursor_y < top || drawn_cursor_y >= bottom){
+			drawn_cursor = 0;
+		}
+	}
+	/* the indicators aren't part of the rows, so clean up any copies
+	 * that moved and draw them again where they belong */
+	for(k = 0; k < NUM_INDICATORS; ++k){
+		int r = indicator_rows[k];
+		if((drawn_indicators & (1 << k)) && r >= top && r < bottom){
+			damage_cells(r, cols - 1, 1);
+			damage_cells(r - n, cols - 1, 1);
+		}
+	}
+}
+
+/* Move the pixels scroll_drawn_rows() planned to */
+static void scroll_pixels(){
+	if(frame.scroll_rows <= 0){
+		return;
+	}
+	if(SDL_MUSTLOCK(screen) && SDL_LockSurface(screen) < 0){
+		/* the rows that moved were left out of the frame, draw them again */
+		full_damage = 1;
+		return;
+	}
+	Uint8* pixels = (Uint8*)screen->pixels;
+	memmove(pixels + frame.scroll_dst * text_height * screen->pitch,
+	        pixels + frame.scroll_src * text_height * screen->pitch,
+	        (size_t)frame.scroll_rows * text_height * screen->pitch);
+	if(SDL_MUSTLOCK(screen)){
+		SDL_UnlockSurface(screen);
+	}
+	add_update_rect(0, frame.scroll_dst * text_height, screen->w, frame.scroll_rows * text_height);
+}
+
+static int cells_redrawn(int row, int col, int n){
+	return row >= 0 && row < rows && redrawn_start[row] < col + n && redrawn_end[row] > col;
+}
+
+static int active_indicators(){
+	int on = 0;
+	if(metamode && metamode_cursor != NULL){ on |= INDICATOR_METAMODE; }
+	if(vmodifiers & KEYMOD_CTRL){ on |= INDICATOR_CTRL; }
+	if(vmodifiers & KEYMOD_ALT){ on |= INDICATOR_ALT; }
+	if(vmodifiers & KEYMOD_SHIFT){ on |= INDICATOR_SHIFT; }
+	if(altsym_lock){ on |= INDICATOR_ALTSYM; }
+	if(bell_on && bell_indicator != NULL){ on |= INDICATOR_BELL; }
+	return on;
+}
+
+static SDL_Surface* indicator_surface(int k){
+	switch(k){
+		case 0: return metamode_cursor;
+		case 1: return ctrl_key_indicator;
+		case 2: return alt_key_indicator;
+		case 3: return shift_key_indicator;
+		case 4: return altsym_indicator;
+		default: return bell_indicator;
+	}
+}
+
+/* Work out where the cursor is: col is the buffer column of the character
+ * under it, and x, y, w the screen cells it covers. */
+static void cursor_cells(int* col, int* x, int* y, int* w){
+	struct screenchar* line = buf->text[buf->line];
+	char line_size = buf_line_info(line)->size;
+	int line_cols = line_size == LINE_SINGLE_WIDTH ? cols : cols / 2;
+	int drawcols = buf->col;
+	if(buf->col >= line_cols){
+		// Don't draw off the edge - also make backspace from the right margin work 'right'
+		drawcols = line_cols > 0 ? line_cols - 1 : 0;
+	}
+	if(line[drawcols].wide == SC_WIDE_RIGHT && drawcols > 0 && line[drawcols-1].wide == SC_WIDE_LEFT){
+		/* put the cursor on the whole character */
+		--drawcols;
+	}
+	*col = drawcols;
+	*y = buf->line - buf->top_line;
+	*w = line[drawcols].wide == SC_WIDE_LEFT ? 2 : 1;
+	*x = drawcols;
+	if(line_size != LINE_SINGLE_WIDTH){
+		*x *= 2;
+		*w *= 2;
+	}
+}
+
+/* Whether sc has anything to draw over its background besides lines */
+static int has_glyph(struct screenchar* sc){
+	return sc->c != 0 && (sc->c != ' ' || sc->combining);
+}
+
+/* Clip a line starting at row of a cell to the cell. Returns its height,
+ * and its first row in *top. */
+static int clip_line(int row, int* top){
+	int bottom = row + line_height < text_height ? row + line_height : text_height;
+	*top = row < 0 ? 0 : row;
+	return bottom - *top;
+}
+
+/* Fill in the underline and strikethrough of sc over w pixels at x, y */
+static void render_lines(struct screenchar* sc, int x, int y, int w, SDL_Color fg){
+	SDL_Rect r;
+	int top, h;
+	if(sc->c == 0 || !(sc->style.style & CELL_LINES)){
+		return;
+	}
+	Uint32 pixel = color_pixel(fg);
+	r.x = x;
+	r.w = w;
+	if(sc->style.style & TTF_STYLE_UNDERLINE){
+		h = clip_line(underline_row, &top);
+		if(h > 0){
+			r.y = y + top;
+			r.h = h;
+			SDL_FillRect(screen, &r, pixel);
+		}
+	}
+	if(sc->style.style & TTF_STYLE_STRIKETHROUGH){
+		h = clip_line(strikethrough_row, &top);
+		if(h > 0){
+			r.y = y + top;
+			r.h = h;
+			SDL_FillRect(screen, &r, pixel);
+		}
+	}
+}
+
+/* Draw cells start to end-1 of a normal size line on screen row i. The
+ * backgrounds go in first, one fill for each run of cells of the same
+ * colour, then the glyphs over just the cells that have one. Most of a
+ * terminal is spaces, which this never blits. */
+static void render_cells(struct screenchar* line, int i, int start, int end){
+	struct screenchar* sc;
+	SDL_Color fg, bg, run_bg;
+	SDL_Color blank = frame.invert ? palette_fg : palette_bg;
+	int y = text_height * i;
+	int run_start = start;
+	int j;
+
+	if(end <= start){
+		return;
+	}
+
+	for(j = start; j < end; ++j){
+		sc = line != NULL ? &line[j] : &blank_sc;
+		if(sc->wide == SC_WIDE_RIGHT && j > 0 && (sc-1)->wide == SC_WIDE_LEFT){
+			/* the right half takes the colours of the left */
+			--sc;
+		}
+		if(sc->c == 0){
+			bg = blank;
+		} else {
+			cell_colors(sc, frame.invert, &fg, &bg);
+		}
+		if(j > start && !same_color(bg, run_bg)){
+			fill_cells(run_start * advance, y, (j - run_start) * advance, run_bg);
+			run_start = j;
+		}
+		run_bg = bg;
+	}
+	fill_cells(run_start * advance, y, (end - run_start) * advance, run_bg);
+
+	for(j = start; j < end; ++j){
+		sc = line != NULL ? &line[j] : &blank_sc;
+		if(sc->c == 0 || blinked_off(sc) || (sc->wide == SC_WIDE_RIGHT && j > 0 && (sc-1)->wide == SC_WIDE_LEFT)){
+			continue;
+		}
+		int x = j * advance;
+		int w = (sc->wide == SC_WIDE_LEFT && j + 1 < cols ? 2 : 1) * advance;
+		cell_colors(sc, frame.invert, &fg, &bg);
+		if(has_glyph(sc)){
+			const Uint32* pixels = color_glyph(sc);
+			const Uint8* mask = pixels == NULL ? glyph_mask(sc) : NULL;
+			if(pixels != NULL){
+				/* over the background filled in above */
+				colorcache_blit(screen, x, y, w, text_height, pixels);
+			} else if(mask != NULL){
+				atlas_blit(screen, x, y, w, text_height, mask, atlas_pitch(), color_rgb(fg), color_rgb(bg));
+			}
+		}
+		render_lines(sc, x, y, w, fg);
+	}
+}
+
+/* Draw the whole of a normal size line on screen row i, copying it from
+ * the row cache if a row with the same cells has been drawn lately */
+static void render_row(struct screenchar* line, int i){
+	char invert = frame.invert;
+	Uint32 hash = rowcache_hash(line, cols, invert);
+	const Uint8* cached = hash ? rowcache_find(hash, line, cols, invert) : NULL;
+	Uint8* store = NULL;
+	int pitch = rowcache_pitch(cols);
+
+	if(cached == NULL){
+		render_cells(line, i, 0, cols);
+		store = hash ? rowcache_add(hash, line, cols, invert) : NULL;
+		if(store == NULL){
+			return;
+		}
+	}
+	if(SDL_MUSTLOCK(screen) && SDL_LockSurface(screen) < 0){
+		return;
+	}
+	Uint8* row = (Uint8*)screen->pixels + i * text_height * screen->pitch;
+	for(int y = 0; y < text_height; ++y){
+		if(cached != NULL){
+			memcpy(row + y * screen->pitch, cached + y * pitch, pitch);
+		} else {
+			memcpy(store + y * pitch, row + y * screen->pitch, pitch);
+		}
+	}
+	if(SDL_MUSTLOCK(screen)){
+		SDL_UnlockSurface(screen);
+	}
+}
+
+static int single_width(struct screenchar* line){
+	return line == NULL || buf_line_info(line)->size == LINE_SINGLE_WIDTH;
+}
+
+static void rasterize_jobs(int worker, int workers, void* data){
+	for(int k = worker; k < num_raster_jobs; k += workers){
+		rasterize_glyph(raster_jobs[k].sc, worker, raster_jobs[k].mask);
+	}
+}
+
+static void fill_pixels(Uint32* dst, int pitch, int w, int h, Uint32 pixel){
+	for(int y = 0; y < h; ++y){
+		for(int x = 0; x < w; ++x){
+			dst[x] = pixel;
+		}
+		dst += pitch;
+	}
+}
+
+/* Draw this worker's band of rows from the masks found by
+ * render_rows_parallel(), in the same two passes as render_cells() */
+static void composite_rows(int worker, int workers, void* data){
+	int pitch = screen->pitch / 4;
+	int row_bytes = cols * advance * 4;
+	int top, h;
+	SDL_Color fg, bg;
+	Uint32 blank_pixel = frame_pixels[frame.invert ? PALETTE_FG : PALETTE_BG];
+
+	for(int i = rows * worker / workers; i < rows * (worker + 1) / workers; ++i){
+		struct screenchar* line = frame.lines[i];
+		Uint32* row = (Uint32*)((Uint8*)screen->pixels + i * text_height * screen->pitch);
+		if(!single_width(line)){
+			continue;
+		}
+		if(row_pixels[i] != NULL){
+			for(int y = 0; y < text_height; ++y){
+				memcpy(row + y * pitch, row_pixels[i] + y * row_bytes, row_bytes);
+			}
+			continue;
+		}
+
+		int run_start = 0;
+		Uint32 run_pixel = blank_pixel;
+		for(int j = 0; j < cols; ++j){
+			struct screenchar* sc = line != NULL ? &line[j] : &blank_sc;
+			Uint32 bg_pixel = blank_pixel;
+			if(sc->wide == SC_WIDE_RIGHT && j > 0 && (sc-1)->wide == SC_WIDE_LEFT){
+				--sc;
+			}
+			if(sc->c != 0){
+				cell_colors(sc, frame.invert, &fg, &bg);
+				bg_pixel = color_pixel(bg);
+			}
+			if(j > 0 && bg_pixel != run_pixel){
+				fill_pixels(row + run_start * advance, pitch, (j - run_start) * advance, text_height, run_pixel);
+				run_start = j;
+			}
+			run_pixel = bg_pixel;
+		}
+		fill_pixels(row + run_start * advance, pitch, (cols - run_start) * advance, text_height, run_pixel);
+
+		for(int j = 0; j < cols; ++j){
+			struct screenchar* sc = line != NULL ? &line[j] : &blank_sc;
+			if(sc->c == 0 || blinked_off(sc) || (sc->wide == SC_WIDE_RIGHT && j > 0 && (sc-1)->wide == SC_WIDE_LEFT)){
+				continue;
+			}
+			int w = (sc->wide == SC_WIDE_LEFT && j + 1 < cols ? 2 : 1) * advance;
+			cell_colors(sc, frame.invert, &fg, &bg);
+			Uint32 fg_pixel = color_pixel(fg);
+			const Uint8* mask = cell_masks[i * cols + j];
+			const Uint32* pixels = cell_color_glyphs[i * cols + j];
+			if(pixels != NULL){
+				colorcache_blend_32(row + j * advance, pitch, pixels, colorcache_pitch(), w, text_height,
+				                    screen->format);
+			} else if(mask != NULL){
+				blit_mask_32(row + j * advance, pitch, mask, atlas_pitch(), w, text_height,
+				             fg_pixel, color_pixel(bg));
+			}
+			if((sc->style.style & TTF_STYLE_UNDERLINE) && (h = clip_line(underline_row, &top)) > 0){
+				fill_pixels(row + top * pitch + j * advance, pitch, w, h, fg_pixel);
+			}
+			if((sc->style.style & TTF_STYLE_STRIKETHROUGH) && (h = clip_line(strikethrough_row, &top)) > 0){
+				fill_pixels(row + top * pitch + j * advance, pitch, w, h, fg_pixel);
+			}
+		}
+	}
+}
+
+/* Fill in the masks render_rows_parallel() has taken so far, which are in
+ * the atlas now, and leave the repaint to the one thread */
+static int render_rows_give_up(){
+	if(num_raster_jobs > 0){
+		renderpool_run(rasterize_jobs, NULL);
+	}
+	atlas_pin_end();
+	return 0;
+}
+
+/* Draw every row of a full repaint with the render pool. Returns 0 without
+ * drawing anything if it has to be done on one thread instead: there is
+ * only one worker, the screen isn't 32 bit, or there are too many new
+ * glyphs. */
+static int render_rows_parallel(){
+	SDL_PixelFormat* fmt = screen->format;
+	char invert = frame.invert;
+	char fresh;
+	int i, j;
+
+	if(renderpool_workers() <= 1 || rows < 2 * renderpool_workers() || fmt->BytesPerPixel != 4 ||
+	   fmt->Rloss != 0 || fmt->Gloss != 0 || fmt->Bloss != 0 ||
+	   fmt->Rshift % 8 != 0 || fmt->Gshift % 8 != 0 || fmt->Bshift % 8 != 0){
+		return 0;
+	}
+
+	/* find the masks, and the rows that are in the row cache */
+	num_raster_jobs = 0;
+	atlas_pin_begin();
+	for(i = 0; i < rows; ++i){
+		struct screenchar* line = frame.lines[i];
+		row_pixels[i] = NULL;
+		row_hashes[i] = 0;
+		if(!single_width(line)){
+			continue;
+		}
+		if(line != NULL){
+			row_hashes[i] = rowcache_hash(line, cols, invert);
+			row_pixels[i] = row_hashes[i] ? rowcache_find(row_hashes[i], line, cols, invert) : NULL;
+			if(row_pixels[i] != NULL){
+				continue;
+			}
+		}
+		for(j = 0; j < cols; ++j){
+			struct screenchar* sc = line != NULL ? &line[j] : &blank_sc;
+			const Uint8** mask = &cell_masks[i * cols + j];
+			const Uint32** pixels = &cell_color_glyphs[i * cols + j];
+			*mask = NULL;
+			*pixels = NULL;
+			if(!has_glyph(sc) || blinked_off(sc)){
+				continue;
+			}
+			/* Colour glyphs are few, and drawn here on this thread.
+			 * Making room for one would drop pixels found for the
+			 * cells before it, so past what the colour glyph cache
+			 * holds the rows are drawn one cell at a time. */
+			if(!colorcache_fits(sc->c) && color_font(sc) >= 0){
+				return render_rows_give_up();
+			}
+			*pixels = color_glyph(sc);
+			if(*pixels != NULL){
+				continue;
+			}
+			*mask = glyph_slot(sc, &fresh);
+			if(*mask == NULL){
+				/* every glyph in the atlas is one this repaint uses */
+				return render_rows_give_up();
+			}
+			if(fresh){
+				raster_jobs[num_raster_jobs].sc = sc;
+				raster_jobs[num_raster_jobs].mask = (Uint8*)*mask;
+				if(++num_raster_jobs == MAX_RASTER_JOBS){
+					return render_rows_give_up();
+				}
+			}
+		}
+	}
+	if(num_raster_jobs > 0){
+		renderpool_run(rasterize_jobs, NULL);
+	}
+	/* nothing more is added to the atlas this repaint */
+	atlas_pin_end();
+
+	if(SDL_MUSTLOCK(screen) && SDL_LockSurface(screen) < 0){
+		return 0;
+	}
+	renderpool_run(composite_rows, NULL);
+	/* keep the new rows for next time */
+	for(i = 0; i < rows; ++i){
+		if(row_hashes[i] == 0 || row_pixels[i] != NULL){
+			continue;
+		}
+		struct screenchar* line = frame.lines[i];
+		Uint8* store = rowcache_add(row_hashes[i], line, cols, invert);
+		if(store == NULL){
+			continue;
+		}
+		int pitch = rowcache_pitch(cols);
+		Uint8* row = (Uint8*)screen->pixels + i * text_height * screen->pitch;
+		for(int y = 0; y < text_height; ++y){
+			memcpy(store + y * pitch, row + y * screen->pitch, pitch);
+		}
+	}
+	if(SDL_MUSTLOCK(screen)){
+		SDL_UnlockSurface(screen);
+	}
+
+	/* double width and height lines are drawn here */
+	for(i = 0; i < rows; ++i){
+		struct screenchar* line = frame.lines[i];
+		if(!single_width(line)){
+			render_scaled_line(line, buf_line_info(line)->size, i * text_height);
+		}
+	}
+	return 1;
+}
+
+/* Draw the cursor over the character under it, which render_frame() has
+ * already drawn. A block cursor draws the character again from its glyph
+ * mask with the colours swapped; the other shapes are a plain fill. */
+static void render_cursor(){
+	struct screenchar* sc = &frame.cursor_sc;
+	char line_size = frame.cursor_size;
+	int x = cursor_x * advance;
+	int y = cursor_y * text_height;
+	int w = frame.cursor_w * advance;
+	SDL_Color fg, bg;
+	SDL_Rect r;
+
+	if(sc->c == 0){
+		/* nothing drawn here yet, it shows the default colours */
+		fg = frame.invert ? palette_bg : palette_fg;
+		bg = frame.invert ? palette_fg : palette_bg;
+	} else {
+		cell_colors(sc, frame.invert, &fg, &bg);
+	}
+
+	r.x = x;
+	r.y = y;
+	r.w = w;
+	r.h = text_height;
+	switch(cursor_shape){
+	case CURSOR_UNDERLINE:
+		r.h = text_height / 8 > 0 ? text_height / 8 : 1;
+		r.y = y + text_height - r.h;
+		break;
+	case CURSOR_BAR:
+		r.w = advance / 8 > 0 ? advance / 8 : 1;
+		break;
+	default:
+		if(has_glyph(sc) && line_size == LINE_SINGLE_WIDTH){
+			const Uint32* pixels = color_glyph(sc);
+			if(pixels != NULL){
+				/* emoji keep their colours, over the cursor */
+				SDL_FillRect(screen, &r, color_pixel(fg));
+				colorcache_blit(screen, x, y, w, text_height, pixels);
+				render_lines(sc, x, y, w, bg);
+				return;
+			}
+		}
+		if(has_glyph(sc)){
+			int scaled = line_size != LINE_SINGLE_WIDTH;
+			const Uint8* mask = scaled ? scaled_glyph(sc, line_size) : glyph_mask(sc);
+			if(mask != NULL){
+				cell_colors(sc, !frame.invert, &fg, &bg);
+				atlas_blit(screen, x, y, w, text_height, mask, scaled ? w : atlas_pitch(), color_rgb(fg), color_rgb(bg));
+				if(!scaled){
+					render_lines(sc, x, y, w, fg);
+				}
+				return;
+			}
+		}
+		break;
+	}
+	SDL_FillRect(screen, &r, color_pixel(fg));
+}
+
+/* Fill the strips on the right and bottom of the screen that don't
+ * make up a whole cell */
+static void fill_margins(Uint32 pixel){
+	SDL_Rect r;
+	int x = cols * advance;
+	int y = rows * text_height;
+	if(x < screen->w){
+		r.x = x;
+		r.y = 0;
+		r.w = screen->w - x;
+		r.h = screen->h;
+		SDL_FillRect(screen, &r, pixel);
+	}
+	if(y < screen->h){
+		r.x = 0;
+		r.y = y;
+		r.w = x < screen->w ? x : screen->w;
+		r.h = screen->h - y;
+		SDL_FillRect(screen, &r, pixel);
+	}
+}
+
+/* Work out what the next frame has to draw, and copy it out of the
+ * buffer. This is the only part of a render that needs the input lock. */
+void render_snapshot() {
+
+	int i, k;
+	int cursor_col = 0;
+	int cursor_w = 1;
+	char blink_shown = 0;
+
+	if(flash){
+		/* show the bell for a moment from the last BEL */
+		flash = 0;
+		bell_on = 1;
+		timer_start(TIMER_BELL, BELL_NSEC);
+	}
+	int indicators = active_indicators();
+	char palette_changed = palette_stale || palette_serial() != drawn_palette;
+	char full = full_damage || palette_changed || buf != drawn_buf || rows != drawn_rows || cols != drawn_cols ||
+	            buf->inverse_video != drawn_inverse || current_symmenu != drawn_symmenu;
+
+	full_damage = 0;
+	frame.scroll_rows = 0;
+	num_frame_marks = 0;
+
+	if(!full){
+		scroll_drawn_rows();
+	}
+	memset(&scroll_damage, 0, sizeof(scroll_damage));
+
+	if(blink_ticked){
+		blink_ticked = 0;
+		if(!damage_blinking()){
+			/* nothing blinks any more */
+			timer_stop(TIMER_BLINK);
+			blink_off = 0;
+		}
+	}
+
+	if (draw_cursor){
+		cursor_cells(&cursor_col, &cursor_x, &cursor_y, &cursor_w);
+	}
+	if(!draw_cursor || !cursor_blink){
+		timer_stop(TIMER_CURSOR);
+		cursor_off = 0;
+	} else if(timer_due[TIMER_CURSOR] == 0 || cursor_x != drawn_cursor_x || cursor_y != drawn_cursor_y){
+		/* the cursor stays on while it moves */
+		timer_start(TIMER_CURSOR, CURSOR_BLINK_NSEC);
+		cursor_off = 0;
+	}
+	char show_cursor = draw_cursor && !cursor_off;
+	char cursor_moved = !drawn_cursor || cursor_x != drawn_cursor_x || cursor_y != drawn_cursor_y || cursor_w != drawn_cursor_w;
+
+	if(!full){
+		/* uncover whatever the old cursor and any removed indicators were sitting on */
+		if(drawn_cursor && (!show_cursor || cursor_moved)){
+			damage_cells(drawn_cursor_y, drawn_cursor_x, drawn_cursor_w);
+		}
+		for(k = 0; k < NUM_INDICATORS; ++k){
+			if((drawn_indicators & (1 << k)) && !(indicators & (1 << k))){
+				damage_cells(indicator_rows[k], cols - 1, 1);
+			}
+		}
+		full = full_damage;
+		full_damage = 0;
+	}
+	frame.full = full;
+	frame.invert = buf->inverse_video;
+	frame.blink_off = blink_off;
+	frame.palette = palette_changed;
+	if(palette_changed){
+		palette_copy(frame_palette);
+		drawn_palette = palette_serial();
+		palette_stale = 0;
+	}
+	frame.symmenu = current_symmenu;
+
+	for(i = 0; i < rows; ++i){
+		struct screenchar* line = screen_line(i);
+		int start = 0;
+		int end = cols;
+		redrawn_start[i] = 0;
+		redrawn_end[i] = 0;
+
+		if(!full && line == drawn_lines[i]){
+			if(line == NULL){
+				continue;
+			}
+			struct line_info* li = buf_line_info(line);
+			if(li->dirty_end <= li->dirty_start || li->dirty_start >= cols){
+				continue;
+			}
+			if(li->size == LINE_SINGLE_WIDTH){
+				start = li->dirty_start;
+				end = li->dirty_end < cols ? li->dirty_end : cols;
+				/* don't split double width characters */
+				if(start > 0 && line[start].wide == SC_WIDE_RIGHT){
+					--start;
+				}
+				if(end < cols && line[end-1].wide == SC_WIDE_LEFT){
+					++end;
+				}
+			}
+		}
+		drawn_lines[i] = line;
+
+		frame.lines[i] = NULL;
+		if(line != NULL){
+			struct line_info* li = buf_line_info(line);
+			struct screenchar* copy = (struct screenchar*)(frame_store + i * frame_line_bytes + sizeof(union line_header));
+			buf_line_info(copy)->size = li->size;
+			/* whole rows, for the row cache and the cells around wide characters */
+			for(int j = 0; j < cols; ++j){
+				frame_copy_cell(&copy[j], &line[j]);
+				blink_shown |= copy[j].style.blink;
+			}
+			frame.lines[i] = copy;
+			li->dirty_start = 0;
+			li->dirty_end = 0;
+		}
+		redrawn_start[i] = start;
+		redrawn_end[i] = end;
+	}
+
+	if(blink_shown && timer_due[TIMER_BLINK] == 0){
+		timer_start(TIMER_BLINK, BLINK_NSEC);
+	}
+
+	frame.cursor = 0;
+	if (show_cursor && cursor_y >= 0 && cursor_y < rows){
+		if(full || cursor_moved || cells_redrawn(cursor_y, cursor_x, cursor_w)){
+			struct screenchar* line = buf->text[buf->line];
+			frame_copy_cell(&frame.cursor_sc, &line[cursor_col]);
+			frame.cursor_size = buf_line_info(line)->size;
+			frame.cursor_w = cursor_w;
+			frame.cursor = 1;
+		}
+	}
+	drawn_cursor = show_cursor;
+	drawn_cursor_x = cursor_x;
+	drawn_cursor_y = cursor_y;
+	drawn_cursor_w = cursor_w;
+
+	frame.indicators = 0;
+	for(k = 0; k < NUM_INDICATORS; ++k){
+		if(!(indicators & (1 << k))){
+			continue;
+		}
+		if(full || !(drawn_indicators & (1 << k)) || cells_redrawn(indicator_rows[k], cols - 1, 1)){
+			frame.indicators |= 1 << k;
+		}
+	}
+	drawn_indicators = indicators;
+
+	drawn_buf = buf;
+	drawn_rows = rows;
+	drawn_cols = cols;
+	drawn_inverse = buf->inverse_video;
+	drawn_symmenu = current_symmenu;
+}
+
+/* Draw the frame render_snapshot() took and put it on the display. This
+ * runs without the input lock, under the render lock. */
+void render_frame() {
+
+	int i, k;
+	char full = frame.full;
+
+	num_update_rects = 0;
+	damage_bottom = 0;
+
+	prewarm_publish();
+	scroll_pixels();
+
+	if(frame.palette){
+		for(i = 0; i < PALETTE_SIZE; ++i){
+			frame_pixels[i] = SDL_MapRGB(screen->format, frame_palette[i].r, frame_palette[i].g, frame_palette[i].b);
+		}
+		/* cached rows have the old colours in them */
+		rowcache_flush();
+	}
+	if(full){
+		/* the rows fill in their own backgrounds, leaving the margins */
+		fill_margins(frame_pixels[PALETTE_BG]);
+	}
+	char parallel = full && render_rows_parallel();
+
+	for(i = 0; i < rows; ++i){
+		struct screenchar* line = frame.lines[i];
+		int start = redrawn_start[i];
+		int end = redrawn_end[i];
+		if(end <= start){
+			continue;
+		}
+
+		SDL_Rect rowrect;
+		rowrect.x = start * advance;
+		rowrect.y = i * text_height;
+		rowrect.w = (end - start) * advance;
+		rowrect.h = text_height;
+		if(line != NULL){
+			struct line_info* li = buf_line_info(line);
+			if(parallel){
+				/* already drawn */
+			} else if(li->size != LINE_SINGLE_WIDTH){
+				render_scaled_line(line, li->size, rowrect.y);
+			} else if(start == 0 && end == cols){
+				render_row(line, i);
+			} else {
+				render_cells(line, i, start, end);
+			}
+		} else if(!parallel){
+			render_cells(NULL, i, start, end);
+		}
+		add_update_rect(rowrect.x, rowrect.y, rowrect.w, rowrect.h);
+	}
+
+	if (frame.cursor){
+		render_cursor();
+		add_update_rect(cursor_x * advance, cursor_y * text_height, frame.cursor_w * advance, text_height);
+	}
+
+	for(k = 0; k < NUM_INDICATORS; ++k){
+		SDL_Surface* indicator = indicator_surface(k);
+		if(!(frame.indicators & (1 << k)) || indicator == NULL){
+			continue;
+		}
+		SDL_Rect destrect;
+		destrect.x = (cols-1) * advance;
+		destrect.y = indicator_rows[k] * text_height;
+		destrect.w = indicator->w;
+		destrect.h = indicator->h;
+		SDL_BlitSurface(indicator, NULL, screen, &destrect);
+		add_update_rect(destrect.x, destrect.y, advance, text_height);
+	}
+
+	if ((frame.symmenu != NULL) && (frame.symmenu->surface != NULL)) {
+		/* blit symmenu surface, if anything was drawn underneath it */
+		SDL_Rect destrect;
+		destrect.w = frame.symmenu->surface->w;
+		destrect.h = frame.symmenu->surface->h;
+		destrect.x = 0;
+		destrect.y = screen->h - frame.symmenu->surface->h;
+
+		if(full || damage_bottom > destrect.y){
+			if (SDL_BlitSurface(frame.symmenu->surface, NULL, screen, &destrect) != 0) {
+				PRINT(stderr, "Symmenu blit failed: %s\n", SDL_GetError());
+			}
+			add_update_rect(destrect.x, destrect.y, destrect.w, destrect.h);
+		}
+	}
+
+	if(headless){
+		/* nothing to show it on */
+	} else if(full){
+		SDL_Flip(screen);
+	} else if(num_update_rects > 0){
+		SDL_UpdateRects(screen, num_update_rects, update_rects);
+	}
+}
+
+/* Snapshot and draw in one go, for callers that don't share the buffer
+ * with another thread */
+void render() {
+	render_snapshot();
+	render_frame();
+}
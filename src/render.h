@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <stdint.h>
+
+#include "SDL.h"
+#include "types.h"
+
+/* The renderer: the fonts, and drawing the text buffer into screen. It
+ * knows nothing of the tty, the keyboard or the window, so it runs on its
+ * own in the renderer benchmark as well as in the app. The render thread
+ * takes a snapshot of the buffer with the input lock held, then draws it
+ * with only the render lock. */
+
+/* bits per pixel of the screen */
+#define PB_D_PIXELS 32
+
+/* from timer_wait() when no timers are running */
+#define TIMER_NONE ((uint64_t)-1)
+
+int font_init(int font_size);
+int font_resize(int font_size);
+void font_uninit();
+
+void render_snapshot();
+void render_frame();
+void render();
+
+uint64_t now_nsec();
+uint64_t timer_wait();
+int run_timers();
+
+#endif /* RENDER_H_ */
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "terminal.h"
+
+#include "renderpool.h"
+
+static SDL_Thread* threads[RENDERPOOL_MAX_WORKERS];
+static SDL_mutex* pool_lock = NULL;
+static SDL_cond* start_cond = NULL;
+static SDL_cond* done_cond = NULL;
+static int num_workers = 1;
+static unsigned int generation = 0; /* bumped for each renderpool_run() */
+static unsigned int first_generation = 0; /* generation when the workers started */
+static int pending = 0;             /* workers still busy with this one */
+static char quit = 0;
+static renderpool_fn job_fn = NULL;
+static void* job_data = NULL;
+
+static int worker_main(void* arg){
+  int worker = (int)(intptr_t)arg;
+  unsigned int done = first_generation;
+
+  SDL_mutexP(pool_lock);
+  for(;;){
+    while(generation == done && !quit){
+      SDL_CondWait(start_cond, pool_lock);
+    }
+    if(quit){
+      break;
+    }
+    done = generation;
+    renderpool_fn fn = job_fn;
+    void* data = job_data;
+    SDL_mutexV(pool_lock);
+
+    fn(worker, num_workers, data);
+
+    SDL_mutexP(pool_lock);
+    if(--pending == 0){
+      SDL_CondSignal(done_cond);
+    }
+  }
+  SDL_mutexV(pool_lock);
+  return 0;
+}
+
+/* Start workers - 1 threads. With 1 worker renderpool_run()
+ * just calls fn on the calling thread. */
+int renderpool_init(int workers){
+  int i;
+  renderpool_uninit();
+  if(workers > RENDERPOOL_MAX_WORKERS){
+    workers = RENDERPOOL_MAX_WORKERS;
+  }
+  if(workers <= 1){
+    return TERM_SUCCESS;
+  }
+  pool_lock = SDL_CreateMutex();
+  start_cond = SDL_CreateCond();
+  done_cond = SDL_CreateCond();
+  if(pool_lock == NULL || start_cond == NULL || done_cond == NULL){
+    fprintf(stderr, "Couldn't create render pool: %s\n", SDL_GetError());
+    renderpool_uninit();
+    return TERM_FAILURE;
+  }
+  quit = 0;
+  first_generation = generation;
+  for(i = 1; i < workers; ++i){
+    threads[i] = SDL_CreateThread(worker_main, (void*)(intptr_t)i);
+    if(threads[i] == NULL){
+      fprintf(stderr, "Couldn't start render worker %d: %s\n", i, SDL_GetError());
+      break;
+    }
+    num_workers = i + 1;
+  }
+  PRINT(stderr, "Render pool: %d workers\n", num_workers);
+  return TERM_SUCCESS;
+}
+
+void renderpool_uninit(){
+  int i;
+  if(pool_lock != NULL){
+    SDL_mutexP(pool_lock);
+    quit = 1;
+    SDL_CondBroadcast(start_cond);
+    SDL_mutexV(pool_lock);
+  }
+  for(i = 1; i < num_workers; ++i){
+    SDL_WaitThread(threads[i], NULL);
+    threads[i] = NULL;
+  }
+  num_workers = 1;
+  if(done_cond != NULL){ SDL_DestroyCond(done_cond); }
+  if(start_cond != NULL){ SDL_DestroyCond(start_cond); }
+  if(pool_lock != NULL){ SDL_DestroyMutex(pool_lock); }
+  done_cond = NULL;
+  start_cond = NULL;
+  pool_lock = NULL;
+}
+
+int renderpool_workers(){
+  return num_workers;
+}
+
+void renderpool_run(renderpool_fn fn, void* data){
+  if(num_workers <= 1){
+    fn(0, 1, data);
+    return;
+  }
+  SDL_mutexP(pool_lock);
+  job_fn = fn;
+  job_data = data;
+  pending = num_workers - 1;
+  ++generation;
+  SDL_CondBroadcast(start_cond);
+  SDL_mutexV(pool_lock);
+
+  fn(0, num_workers, data);
+
+  SDL_mutexP(pool_lock);
+  while(pending > 0){
+    SDL_CondWait(done_cond, pool_lock);
+  }
+  SDL_mutexV(pool_lock);
+}
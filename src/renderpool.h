@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RENDERPOOL_H_
+#define RENDERPOOL_H_
+
+/* A small pool of threads to share the work of a full repaint.
+ * renderpool_run() calls fn on every worker at once, with the calling
+ * thread as worker 0, and returns when they have all finished. Each call
+ * gets its worker number and the number of workers, to split the work
+ * up between them. */
+
+#define RENDERPOOL_MAX_WORKERS 8
+
+typedef void (*renderpool_fn)(int worker, int workers, void* data);
+
+int renderpool_init(int workers);
+void renderpool_uninit();
+int renderpool_workers();
+void renderpool_run(renderpool_fn fn, void* data);
+
+#endif /* RENDERPOOL_H_ */
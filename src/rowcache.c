@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "terminal.h"
+
+#include "rowcache.h"
+
+#define ROWCACHE_BUCKETS 512
+
+struct row_entry {
+  Uint32 hash;
+  int n;
+  char invert;
+  struct screenchar* cells; /* copy of the row, to check hash matches */
+  Uint8* pixels;
+  size_t bytes;
+  struct row_entry* bucket_next;
+  struct row_entry* newer;
+  struct row_entry* older;
+};
+
+static struct row_entry* buckets[ROWCACHE_BUCKETS];
+static struct row_entry* newest = NULL;
+static struct row_entry* oldest = NULL;
+static size_t used_bytes = 0;
+static size_t max_bytes = 0;
+static int row_cell_w = 0;
+static int row_h = 0;
+static int row_bpp = 0;
+static unsigned long hits = 0;
+static unsigned long misses = 0;
+static unsigned long evictions = 0;
+
+int rowcache_init(int cell_w, int cell_h, int bytes_per_pixel, size_t max){
+  rowcache_flush();
+  row_cell_w = cell_w;
+  row_h = cell_h;
+  row_bpp = bytes_per_pixel;
+  max_bytes = max;
+  PRINT(stderr, "Row cache: %lu kB of %dx%d cells\n", (unsigned long)(max / 1024), cell_w, cell_h);
+  return TERM_SUCCESS;
+}
+
+void rowcache_uninit(){
+  PRINT(stderr, "Row cache: %lu hits, %lu misses, %lu evictions\n", hits, misses, evictions);
+  rowcache_flush();
+  max_bytes = 0;
+}
+
+static void rowcache_free(struct row_entry* e){
+  used_bytes -= e->bytes;
+  free(e->cells);
+  free(e->pixels);
+  free(e);
+}
+
+/* forget every row */
+void rowcache_flush(){
+  struct row_entry* e = newest;
+  while(e != NULL){
+    struct row_entry* next = e->older;
+    rowcache_free(e);
+    e = next;
+  }
+  memset(buckets, 0, sizeof(buckets));
+  newest = NULL;
+  oldest = NULL;
+  used_bytes = 0;
+}
+
+/* bytes between pixel rows of a cached row n cells wide */
+int rowcache_pitch(int n){
+  return n * row_cell_w * row_bpp;
+}
+
+/* Returns the hash of the first n cells of line, or 0 if the row can't
+ * be cached. Rows with combining marks are left out, since the marks
+ * live outside the cells, and so are rows with blinking text, which
+ * look different from one frame to the next. */
+Uint32 rowcache_hash(struct screenchar* line, int n, char invert){
+  Uint32 h = 2166136261u;
+  int i;
+  if(max_bytes == 0){
+    return 0;
+  }
+  for(i = 0; i < n; ++i){
+    struct screenchar* sc = &line[i];
+    if(sc->combining || sc->style.blink){
+      return 0;
+    }
+    h = (h ^ (Uint32)sc->c) * 16777619u;
+    h = (h ^ ((Uint32)sc->style.fg_color.unused << 24 | sc->style.fg_color.r << 16 | sc->style.fg_color.g << 8 | sc->style.fg_color.b)) * 16777619u;
+    h = (h ^ ((Uint32)sc->style.bg_color.unused << 24 | sc->style.bg_color.r << 16 | sc->style.bg_color.g << 8 | sc->style.bg_color.b)) * 16777619u;
+    h = (h ^ (Uint32)(sc->style.style << 2 | sc->wide)) * 16777619u;
+  }
+  h = (h ^ (Uint32)invert) * 16777619u;
+  return h != 0 ? h : 1;
+}
+
+static int same_cell(struct screenchar* a, struct screenchar* b){
+  return a->c == b->c && a->wide == b->wide && a->style.style == b->style.style &&
+         a->style.fg_color.unused == b->style.fg_color.unused &&
+         a->style.bg_color.unused == b->style.bg_color.unused &&
+         a->style.fg_color.r == b->style.fg_color.r &&
+         a->style.fg_color.g == b->style.fg_color.g &&
+         a->style.fg_color.b == b->style.fg_color.b &&
+         a->style.bg_color.r == b->style.bg_color.r &&
+         a->style.bg_color.g == b->style.bg_color.g &&
+         a->style.bg_color.b == b->style.bg_color.b;
+}
+
+static int same_row(struct row_entry* e, Uint32 hash, struct screenchar* line, int n, char invert){
+  int i;
+  if(e->hash != hash || e->n != n || e->invert != invert){
+    return 0;
+  }
+  for(i = 0; i < n; ++i){
+    if(!same_cell(&e->cells[i], &line[i])){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void lru_unlink(struct row_entry* e){
+  if(e->newer != NULL){ e->newer->older = e->older; } else { newest = e->older; }
+  if(e->older != NULL){ e->older->newer = e->newer; } else { oldest = e->newer; }
+  e->newer = NULL;
+  e->older = NULL;
+}
+
+static void lru_push(struct row_entry* e){
+  e->newer = NULL;
+  e->older = newest;
+  if(newest != NULL){ newest->newer = e; }
+  newest = e;
+  if(oldest == NULL){ oldest = e; }
+}
+
+static void bucket_unlink(struct row_entry* e){
+  struct row_entry** p = &buckets[e->hash % ROWCACHE_BUCKETS];
+  while(*p != NULL){
+    if(*p == e){
+      *p = e->bucket_next;
+      return;
+    }
+    p = &(*p)->bucket_next;
+  }
+}
+
+/* Returns the pixels of the row with these cells, or NULL if it isn't
+ * cached. hash is from rowcache_hash(). */
+const Uint8* rowcache_find(Uint32 hash, struct screenchar* line, int n, char invert){
+  struct row_entry* e;
+  for(e = buckets[hash % ROWCACHE_BUCKETS]; e != NULL; e = e->bucket_next){
+    if(same_row(e, hash, line, n, invert)){
+      lru_unlink(e);
+      lru_push(e);
+      ++hits;
+      return e->pixels;
+    }
+  }
+  ++misses;
+  return NULL;
+}
+
+/* Returns a buffer for the pixels of a new row, rowcache_pitch(n) bytes
+ * wide, to be filled in by the caller. Returns NULL if the row doesn't
+ * fit in the cache. */
+Uint8* rowcache_add(Uint32 hash, struct screenchar* line, int n, char invert){
+  size_t pixel_bytes = (size_t)rowcache_pitch(n) * row_h;
+  size_t bytes = sizeof(struct row_entry) + n * sizeof(struct screenchar) + pixel_bytes;
+  struct row_entry* e;
+
+  if(bytes > max_bytes){
+    return NULL;
+  }
+  while(used_bytes + bytes > max_bytes && oldest != NULL){
+    e = oldest;
+    lru_unlink(e);
+    bucket_unlink(e);
+    rowcache_free(e);
+    ++evictions;
+  }
+
+  e = (struct row_entry*)calloc(1, sizeof(struct row_entry));
+  if(e == NULL){
+    return NULL;
+  }
+  e->cells = (struct screenchar*)malloc(n * sizeof(struct screenchar));
+  e->pixels = (Uint8*)malloc(pixel_bytes);
+  if(e->cells == NULL || e->pixels == NULL){
+    free(e->cells);
+    free(e->pixels);
+    free(e);
+    return NULL;
+  }
+  memcpy(e->cells, line, n * sizeof(struct screenchar));
+  e->hash = hash;
+  e->n = n;
+  e->invert = invert;
+  e->bytes = bytes;
+  used_bytes += bytes;
+  e->bucket_next = buckets[hash % ROWCACHE_BUCKETS];
+  buckets[hash % ROWCACHE_BUCKETS] = e;
+  lru_push(e);
+  return e->pixels;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2013 Todd Mortimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROWCACHE_H_
+#define ROWCACHE_H_
+
+#include "SDL.h"
+#include "buffer.h"
+
+/* The row cache keeps the pixels of recently drawn rows, keyed by a hash
+ * of their cells. Drawing a row that is already in the cache is a copy of
+ * its pixels, instead of a blit for every cell. Rows are kept in least
+ * recently used order, and the oldest ones are dropped to stay under the
+ * memory limit. */
+
+int rowcache_init(int cell_w, int cell_h, int bytes_per_pixel, size_t max_bytes);
+void rowcache_uninit();
+void rowcache_flush();
+Uint32 rowcache_hash(struct screenchar* line, int n, char invert);
+const Uint8* rowcache_find(Uint32 hash, struct screenchar* line, int n, char invert);
+Uint8* rowcache_add(Uint32 hash, struct screenchar* line, int n, char invert);
+int rowcache_pitch(int n);
+
+#endif /* ROWCACHE_H_ */
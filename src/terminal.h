@@ -45,6 +45,8 @@ void setup_screen_size(int w, int h);
 void set_screen_cols(int cols);
 
 int init();
+int render_init();
+void render_uninit();
 void uninit();
 
 #define SDL_BLACK       {.r = 0,   .g = 0,   .b = 0}
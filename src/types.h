@@ -27,12 +27,12 @@ typedef struct _symmenu_t {
 } symmenu_t;
 
 typedef struct _pref_t {
-	char *font_path;
+	char *font_path, *font_bold_path, *font_italic_path, *font_bold_italic_path;
 	int font_size, *text_color, *background_color, screen_idle_awake,
 		auto_show_vkb, metamode_doubletap_key, metamode_doubletap_delay,
 		keyhold_actions, metamode_hold_key, allow_resize_columns;
 	hitbox_t *metamode_hitbox;
-	char *tty_encoding;
+	char *tty_encoding, *cursor_shape;
 	
 	/* terminated by NULL pointer */
 	keymap_t *metamode_keys, *metamode_sticky_keys, *metamode_func_keys;
@@ -44,6 +44,13 @@ typedef struct _pref_t {
 	int sticky_sym_key, sticky_shift_key, sticky_alt_key;
 	int *keyhold_actions_exempt; /* terminated by -1 */
 	int rescreen_for_symmenu, keyhold_accents, prefs_version;
+	int row_cache_size;
+	int color_cache_size;
+	int render_threads;
+	int glyph_cache;
+	int frame_rate, battery_frame_rate;
+	int cursor_blink;
+	char **fallback_fonts; /* terminated by NULL pointer */
 } pref_t;
 
 #endif